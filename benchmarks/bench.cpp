@@ -0,0 +1,295 @@
+/// @file bench.cpp
+/// @brief Benchmarks of the thread pool under typical task mixes
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/14
+///
+/// Usage: bench.out [--quick] [--filter TEXT] [--output FILE]
+///                  [--baseline FILE]
+///
+/// Every result is printed as "name value unit". With `--output` the results
+/// are also written to FILE, and with `--baseline` they are compared with the
+/// results of an earlier run stored in FILE.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../tiny_tp.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+  std::string name;
+  double value;
+  /// @brief "ops/s" results are better when higher, "ns" ones when lower.
+  std::string unit;
+};
+
+static std::vector<Result> results;
+static bool quick = false;
+static const char* filter = nullptr;
+
+static bool Selected(const std::string& name) {
+  return filter == nullptr || name.find(filter) != std::string::npos;
+}
+static void Report(const std::string& name, double value,
+                   const std::string& unit) {
+  std::printf("%-48s %14.1f %s\n", name.c_str(), value, unit.c_str());
+  std::fflush(stdout);
+  results.push_back(Result{name, value, unit});
+}
+static double Seconds(Clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+static std::uint32_t HardwareThreads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+static const char* SchedulingName(tiny_tp::Scheduling scheduling) {
+  return scheduling == tiny_tp::Scheduling::kWorkStealing ? "stealing"
+                                                          : "global";
+}
+static tiny_tp::ThreadPool::Options MakeOptions(
+    std::uint32_t threads, tiny_tp::Scheduling scheduling) {
+  tiny_tp::ThreadPool::Options options;
+  options.num_threads = threads;
+  options.scheduling = scheduling;
+  options.max_queue_size = 1u << 20;
+  return options;
+}
+/// @brief Busy work of roughly `iterations` nanoseconds.
+static void Spin(unsigned iterations) {
+  volatile unsigned sink = 0;
+  for (unsigned i = 0; i < iterations; ++i) {
+    sink = sink + i;
+  }
+}
+
+/// @brief Empty tasks submitted from one thread outside of the pool.
+static void EmptyTaskThroughput(tiny_tp::Scheduling scheduling) {
+  std::string name = std::string{"empty_tasks/"} + SchedulingName(scheduling);
+  if (!Selected(name)) {
+    return;
+  }
+  const std::size_t count = quick ? 100000 : 1000000;
+  tiny_tp::ThreadPool tp{MakeOptions(HardwareThreads(), scheduling)};
+  auto start = Clock::now();
+  for (std::size_t i = 0; i < count; ++i) {
+    while (!tp.Submit([]() {}).valid()) {
+      std::this_thread::yield();
+    }
+  }
+  tp.WaitIdle();
+  Report(name, count / Seconds(Clock::now() - start), "ops/s");
+}
+
+/// @brief Time from `Submit` to the start of the task, for a pool that is
+/// idle between tasks.
+static void SubmitToStartLatency(tiny_tp::IdlePolicy policy,
+                                 const char* policy_name) {
+  std::string name = std::string{"latency/"} + policy_name;
+  if (!Selected(name)) {
+    return;
+  }
+  const int count = quick ? 2000 : 20000;
+  auto options = MakeOptions(std::min(4u, HardwareThreads()),
+                             tiny_tp::Scheduling::kGlobalQueue);
+  options.idle_policy = policy;
+  tiny_tp::ThreadPool tp{options};
+  tiny_tp::Histogram histogram;
+  for (int i = 0; i < count; ++i) {
+    auto submitted = Clock::now();
+    tp.Submit([submitted]() { return Clock::now() - submitted; })
+        .Then([&histogram](tiny_tp::Future<Clock::duration>& latency) {
+          // Continuations run one at a time, on the thread of the task.
+          histogram.Record(static_cast<std::uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  latency.Get())
+                  .count()));
+        });
+    tp.WaitIdle();
+  }
+  Report(name + "/p50", histogram.Percentile(0.50).count(), "ns");
+  Report(name + "/p99", histogram.Percentile(0.99).count(), "ns");
+  Report(name + "/p999", histogram.Percentile(0.999).count(), "ns");
+}
+
+/// @brief Rounds of a task that fans out into children and waits for all of
+/// their futures.
+static void FanOutFanIn(tiny_tp::Scheduling scheduling) {
+  std::string name = std::string{"fan_out_in/"} + SchedulingName(scheduling);
+  if (!Selected(name)) {
+    return;
+  }
+  const int rounds = quick ? 100 : 1000;
+  const int width = 256;
+  tiny_tp::ThreadPool tp{MakeOptions(HardwareThreads(), scheduling)};
+  auto start = Clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    std::vector<tiny_tp::Future<unsigned>> children;
+    children.reserve(width);
+    for (int i = 0; i < width; ++i) {
+      children.push_back(tp.Submit([i]() {
+        Spin(1000);
+        return static_cast<unsigned>(i);
+      }));
+    }
+    unsigned sum = 0;
+    for (auto& child : children) {
+      sum += child.Get();
+    }
+    if (sum != width * (width - 1) / 2) {
+      std::printf("fan-in mismatch\n");
+    }
+  }
+  Report(name, rounds * width / Seconds(Clock::now() - start), "ops/s");
+}
+
+/// @brief Empty tasks submitted by 1 to N concurrent producers.
+static void ProducerSweep(tiny_tp::Scheduling scheduling) {
+  const std::uint32_t threads = HardwareThreads();
+  const std::size_t per_producer = quick ? 20000 : 200000;
+  for (std::uint32_t producers = 1; producers <= 2 * threads;
+       producers *= 2) {
+    std::ostringstream name;
+    name << "producers/" << SchedulingName(scheduling) << "/" << producers;
+    if (!Selected(name.str())) {
+      continue;
+    }
+    tiny_tp::ThreadPool tp{MakeOptions(threads, scheduling)};
+    std::vector<std::thread> threads_of_producers;
+    auto start = Clock::now();
+    for (std::uint32_t p = 0; p < producers; ++p) {
+      threads_of_producers.emplace_back([&tp, per_producer]() {
+        for (std::size_t i = 0; i < per_producer; ++i) {
+          while (!tp.Submit([]() {}).valid()) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+    for (auto& producer : threads_of_producers) {
+      producer.join();
+    }
+    tp.WaitIdle();
+    Report(name.str(),
+           producers * per_producer / Seconds(Clock::now() - start), "ops/s");
+  }
+}
+
+/// @brief A fixed amount of small compute tasks on 1 to N threads.
+static void ThreadScaling(tiny_tp::Scheduling scheduling) {
+  const std::size_t count = quick ? 20000 : 200000;
+  for (std::uint32_t threads = 1; threads <= HardwareThreads();
+       threads *= 2) {
+    std::ostringstream name;
+    name << "scaling/" << SchedulingName(scheduling) << "/" << threads;
+    if (!Selected(name.str())) {
+      continue;
+    }
+    tiny_tp::ThreadPool tp{MakeOptions(threads, scheduling)};
+    std::atomic<std::size_t> done{0};
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < count; ++i) {
+      tp.Submit([&done]() {
+        Spin(2000);
+        done.fetch_add(1, std::memory_order_relaxed);
+      });
+    }
+    tp.WaitIdle();
+    Report(name.str(), done / Seconds(Clock::now() - start), "ops/s");
+  }
+}
+
+static std::map<std::string, Result> Load(const char* path) {
+  std::map<std::string, Result> loaded;
+  std::ifstream file{path};
+  Result result;
+  while (file >> result.name >> result.value >> result.unit) {
+    loaded[result.name] = result;
+  }
+  return loaded;
+}
+static void Save(const char* path) {
+  std::ofstream file{path};
+  for (const auto& result : results) {
+    file << result.name << " " << result.value << " " << result.unit << "\n";
+  }
+}
+/// @brief Prints the change against `path`, positive when better.
+static void Compare(const char* path) {
+  auto baseline = Load(path);
+  if (baseline.empty()) {
+    std::printf("\nno baseline in %s\n", path);
+    return;
+  }
+  std::printf("\n%-48s %14s %14s %9s\n", "compared with baseline", "baseline",
+              "current", "change");
+  for (const auto& result : results) {
+    auto found = baseline.find(result.name);
+    if (found == baseline.end() || found->second.value == 0) {
+      continue;
+    }
+    double change = (result.value - found->second.value) / found->second.value;
+    if (result.unit == "ns") {
+      change = -change;
+    }
+    std::printf("%-48s %14.1f %14.1f %+8.1f%%%s\n", result.name.c_str(),
+                found->second.value, result.value, change * 100,
+                change < -0.05 ? "  regressed" : "");
+  }
+}
+
+int main(int argc, char* argv[]) {
+  const char* output = nullptr;
+  const char* baseline = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+      baseline = argv[++i];
+    } else {
+      std::printf(
+          "usage: %s [--quick] [--filter TEXT] [--output FILE] "
+          "[--baseline FILE]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  const tiny_tp::Scheduling schedulings[] = {
+      tiny_tp::Scheduling::kGlobalQueue, tiny_tp::Scheduling::kWorkStealing};
+  for (auto scheduling : schedulings) {
+    EmptyTaskThroughput(scheduling);
+  }
+  SubmitToStartLatency(tiny_tp::IdlePolicy::kBlock, "block");
+  SubmitToStartLatency(tiny_tp::IdlePolicy::kSpinYieldPark, "spin");
+  for (auto scheduling : schedulings) {
+    FanOutFanIn(scheduling);
+  }
+  for (auto scheduling : schedulings) {
+    ProducerSweep(scheduling);
+  }
+  for (auto scheduling : schedulings) {
+    ThreadScaling(scheduling);
+  }
+  if (output != nullptr) {
+    Save(output);
+  }
+  if (baseline != nullptr) {
+    Compare(baseline);
+  }
+  return 0;
+}
@@ -0,0 +1,101 @@
+/// @file backpressure.cpp
+/// @brief An example where producers wait for space in a full queue, or for
+/// a credit of their group, instead of having their tasks rejected
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+/// @brief Holds its thread until `open` is set.
+class GateTask : public tiny_tp::ITask {
+ public:
+  GateTask(std::atomic<bool>* open, std::atomic<int>* started)
+      : open_{open}, started_{started} {}
+  std::shared_ptr<void> Execute() override {
+    started_->fetch_add(1);
+    while (!open_->load()) {
+      std::this_thread::yield();
+    }
+    return nullptr;
+  }
+
+ private:
+  std::atomic<bool>* open_;
+  std::atomic<int>* started_;
+};
+
+constexpr std::chrono::milliseconds kTimeout{20};
+
+/// @brief Returns a one-thread pool with room for one queued task.
+std::unique_ptr<tiny_tp::ThreadPool> MakePool() {
+  tiny_tp::ThreadPool::Options options;
+  options.num_threads = 1;
+  options.max_queue_size = 1;
+  return std::unique_ptr<tiny_tp::ThreadPool>{new tiny_tp::ThreadPool{options}};
+}
+
+int main(void) {
+  int failures = 0;
+  {
+    // The thread runs the first gate, the second one fills the queue.
+    auto tp = MakePool();
+    std::atomic<bool> open{false};
+    std::atomic<int> started{0};
+    tp->Drop(std::make_shared<GateTask>(&open, &started));
+    while (started.load() == 0) {
+      std::this_thread::yield();
+    }
+    tp->Drop(std::make_shared<GateTask>(&open, &started));
+    failures += Check(!tp->Drop(std::make_shared<GateTask>(&open, &started)),
+                      "Drop rejects a task while the queue is full");
+    auto begin = std::chrono::steady_clock::now();
+    bool added = tp->DropFor(std::make_shared<GateTask>(&open, &started),
+                             kTimeout);
+    failures += Check(!added && std::chrono::steady_clock::now() - begin >=
+                                    kTimeout,
+                      "DropFor gives up after its timeout");
+
+    std::atomic<bool> returned{false};
+    std::thread producer{[&] {
+      tp->DropWait(std::make_shared<GateTask>(&open, &started));
+      returned.store(true);
+    }};
+    std::this_thread::sleep_for(kTimeout);
+    failures += Check(!returned.load(),
+                      "DropWait waits while the queue is full");
+    open.store(true);
+    producer.join();
+    tp->WaitIdle();
+    failures += Check(returned.load() && started.load() == 3,
+                      "DropWait adds the task once there is space");
+  }
+  {
+    auto tp = MakePool();
+    tiny_tp::AdmissionCredits credits{2};
+    std::atomic<bool> open{false};
+    std::atomic<int> started{0};
+    bool added = tp->DropWait(std::make_shared<GateTask>(&open, &started),
+                              credits) &&
+                 tp->DropWait(std::make_shared<GateTask>(&open, &started),
+                              credits);
+    failures += Check(added && credits.available() == 0,
+                      "every admitted task holds a credit");
+    failures += Check(
+        !tp->DropFor(std::make_shared<GateTask>(&open, &started), kTimeout,
+                     credits),
+        "DropFor gives up without a credit");
+    open.store(true);
+    tp->WaitIdle();
+    failures += Check(credits.available() == 2,
+                      "finished tasks give their credits back");
+  }
+  return failures == 0 ? 0 : 1;
+}
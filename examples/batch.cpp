@@ -0,0 +1,112 @@
+/// @file batch.cpp
+/// @brief An example where threads take several tasks from the shared queue
+/// at once with `Options::dequeue_batch`
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+constexpr std::uint32_t kBatch = 16;
+
+class IdTask : public tiny_tp::ITask {
+ public:
+  explicit IdTask(int id) : id_{id} {}
+  std::shared_ptr<void> Execute() override {
+    return std::make_shared<int>(id_);
+  }
+
+ private:
+  int id_;
+};
+
+/// @brief Returns a pool of `threads` threads taking up to `kBatch` tasks.
+std::unique_ptr<tiny_tp::ThreadPool> MakePool(std::uint32_t threads) {
+  tiny_tp::ThreadPool::Options options;
+  options.num_threads = threads;
+  options.dequeue_batch = kBatch;
+  return std::unique_ptr<tiny_tp::ThreadPool>{new tiny_tp::ThreadPool{options}};
+}
+
+/// @brief Holds the only thread of `tp` until `open` is set.
+void Hold(tiny_tp::ThreadPool& tp, std::atomic<bool>& open) {
+  std::atomic<bool> started{false};
+  tp.Submit([&open, &started] {
+    started.store(true);
+    while (!open.load()) {
+      std::this_thread::yield();
+    }
+  });
+  while (!started.load()) {
+    std::this_thread::yield();
+  }
+}
+
+int main(void) {
+  int failures = 0;
+  {
+    auto tp = MakePool(4);
+    constexpr int kTasks = 10000;
+    for (int i = 0; i < kTasks; ++i) {
+      tp->DropWait(std::make_shared<IdTask>(i));
+    }
+    tp->WaitIdle();
+    // Results of a batch are published at its end, but before WaitIdle
+    // returns.
+    auto results = tp->GrabAllResults();
+    long long sum = 0;
+    for (const auto& result : results) {
+      sum += *std::static_pointer_cast<int>(result);
+    }
+    failures += Check(results.size() == kTasks &&
+                          sum == (kTasks - 1LL) * kTasks / 2,
+                      "every batched task runs and publishes its result");
+  }
+  {
+    // The first task of the batch waits for the second one.
+    auto tp = MakePool(1);
+    std::atomic<bool> open{false};
+    Hold(*tp, open);
+    std::shared_ptr<tiny_tp::Future<int>> second{new tiny_tp::Future<int>};
+    auto first = tp->Submit([&tp, second] {
+      tp->WaitFor(*second);
+      return second->Get() + 1;
+    });
+    *second = tp->Submit([] { return 1; });
+    open.store(true);
+    failures += Check(first.Get() == 2,
+                      "WaitFor runs the rest of the batch meanwhile");
+  }
+  {
+    // A high-priority task submitted during a batch runs next.
+    auto tp = MakePool(1);
+    std::atomic<bool> open{false};
+    Hold(*tp, open);
+    std::mutex mtx;
+    std::string order;
+    auto record = [&mtx, &order](char name) {
+      std::lock_guard<std::mutex> guard{mtx};
+      order += name;
+    };
+    tp->Post([&tp, record] {
+      record('0');
+      tp->Post(tiny_tp::Priority::kHigh, record, 'h');
+    });
+    for (char name = '1'; name <= '7'; ++name) {
+      tp->Post(record, name);
+    }
+    open.store(true);
+    tp->WaitIdle();
+    failures += Check(order == "0h1234567",
+                      "urgent tasks overtake the rest of a batch");
+  }
+  return failures == 0 ? 0 : 1;
+}
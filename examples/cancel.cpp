@@ -0,0 +1,107 @@
+/// @file cancel.cpp
+/// @brief An example that withdraws queued tasks with cancellation tokens,
+/// cancelled by hand or by a deadline
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+/// @brief Holds the only thread of `tp` until `open` is set.
+void Hold(tiny_tp::ThreadPool& tp, std::atomic<bool>& open) {
+  std::atomic<bool> started{false};
+  tp.Submit([&open, &started] {
+    started.store(true);
+    while (!open.load()) {
+      std::this_thread::yield();
+    }
+  });
+  while (!started.load()) {
+    std::this_thread::yield();
+  }
+}
+
+/// @brief Returns whether `future` throws `TaskCancelled`.
+template <typename R>
+bool IsCancelled(tiny_tp::Future<R>& future) {
+  try {
+    future.Get();
+  } catch (const tiny_tp::TaskCancelled&) {
+    return true;
+  }
+  return false;
+}
+
+class CountTask : public tiny_tp::ITask {
+ public:
+  explicit CountTask(std::atomic<int>* count) : count_{count} {}
+  std::shared_ptr<void> Execute() override {
+    count_->fetch_add(1);
+    return std::make_shared<int>(0);
+  }
+
+ private:
+  std::atomic<int>* count_;
+};
+
+int main(void) {
+  int failures = 0;
+  tiny_tp::ThreadPool tp{1};
+  {
+    std::atomic<bool> open{false};
+    Hold(tp, open);
+    std::atomic<int> ran{0};
+    tiny_tp::CancellationToken token;
+    tiny_tp::CancellationToken copy{token};
+    auto cancelled = tp.Submit(token, [&ran] { ran.fetch_add(1); });
+    auto kept = tp.Submit(tiny_tp::CancellationToken{},
+                          [&ran] { return ran.fetch_add(1) + 1; });
+    tp.Drop(std::make_shared<CountTask>(&ran), token);
+    copy.Cancel();
+    open.store(true);
+    tp.WaitIdle();
+    failures += Check(token.IsCancelled() && IsCancelled(cancelled),
+                      "a task whose token was cancelled by a copy throws "
+                      "TaskCancelled");
+    failures += Check(kept.Get() == 1 && ran.load() == 1 &&
+                          tp.QueryResultsCount() == 0,
+                      "only the tasks of tokens not cancelled run");
+  }
+  {
+    std::atomic<bool> open{false};
+    Hold(tp, open);
+    tiny_tp::CancellationToken token{std::chrono::steady_clock::now() +
+                                     std::chrono::milliseconds{10}};
+    auto late = tp.Submit(token, [] {});
+    std::this_thread::sleep_for(std::chrono::milliseconds{30});
+    open.store(true);
+    failures += Check(IsCancelled(late),
+                      "a task still queued after its deadline is cancelled");
+  }
+  {
+    tiny_tp::CancellationToken token;
+    std::atomic<bool> started{false};
+    auto polling = tp.Submit(token, [&token, &started] {
+      started.store(true);
+      while (!token.IsCancelled()) {
+        std::this_thread::yield();
+      }
+      return true;
+    });
+    while (!started.load()) {
+      std::this_thread::yield();
+    }
+    token.Cancel();
+    failures += Check(polling.Get(),
+                      "a running task is not interrupted but can poll its "
+                      "token");
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+/// @file check.hpp
+/// @brief The helper the self-checking examples report their checks with
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#ifndef TINY_TP_EXAMPLES_CHECK_HPP_
+#define TINY_TP_EXAMPLES_CHECK_HPP_
+
+#include <cstdio>
+
+/// @brief Prints whether `what` holds.
+/// @return 1 if it failed, 0 otherwise, to be summed into the exit status.
+inline int Check(bool ok, const char* what) {
+  std::printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+  return ok ? 0 : 1;
+}
+
+#endif  // TINY_TP_EXAMPLES_CHECK_HPP_
@@ -0,0 +1,70 @@
+/// @file elastic.cpp
+/// @brief An example where an elastic pool grows while its threads are busy
+/// and shrinks back after they have been idle for `keep_alive`
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+constexpr std::uint32_t kMinThreads = 1;
+constexpr std::uint32_t kMaxThreads = 4;
+
+/// @brief Submits `kMaxThreads` tasks that wait for each other, so they only
+/// finish if they all run at once.
+/// @return True if they did before a generous deadline.
+bool RunTogether(tiny_tp::ThreadPool& tp) {
+  std::atomic<std::uint32_t> arrived{0};
+  std::atomic<std::uint32_t> met{0};
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  for (std::uint32_t i = 0; i < kMaxThreads; ++i) {
+    tp.Submit([&arrived, &met, deadline] {
+      arrived.fetch_add(1);
+      while (arrived.load() < kMaxThreads &&
+             std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::yield();
+      }
+      met.fetch_add(arrived.load() == kMaxThreads ? 1 : 0);
+    });
+  }
+  tp.WaitIdle();
+  return met.load() == kMaxThreads;
+}
+
+/// @brief Waits up to a generous deadline for `tp` to run `threads` threads.
+bool WaitForThreads(tiny_tp::ThreadPool& tp, std::uint32_t threads) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  while (tp.num_threads() != threads &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  }
+  return tp.num_threads() == threads;
+}
+
+int main(void) {
+  int failures = 0;
+  tiny_tp::ThreadPool::Options options;
+  options.num_threads = kMinThreads;
+  options.max_threads = kMaxThreads;
+  options.keep_alive = std::chrono::milliseconds{50};
+  tiny_tp::ThreadPool tp{options};
+  failures += Check(tp.num_threads() == kMinThreads &&
+                        tp.max_threads() == kMaxThreads,
+                    "an elastic pool starts with num_threads threads");
+  failures += Check(RunTogether(tp) && tp.num_threads() == kMaxThreads,
+                    "busy threads make the pool grow up to max_threads");
+  failures += Check(WaitForThreads(tp, kMinThreads),
+                    "idle threads exit after keep_alive down to num_threads");
+  failures += Check(RunTogether(tp), "the pool grows again after shrinking");
+
+  tiny_tp::ThreadPool fixed{2};
+  failures += Check(fixed.num_threads() == 2 && fixed.max_threads() == 2,
+                    "a pool without max_threads is fixed");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+/// @file executor.cpp
+/// @brief An example that runs CPU-bound work and blocking calls on the two
+/// pools of an `Executor`, handing tasks between them
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+constexpr int kBlockingCalls = 8;
+
+int main(void) {
+  int failures = 0;
+  {
+    tiny_tp::Executor::Options options;
+    options.cpu.num_threads = 2;
+    tiny_tp::Executor executor{options};
+    failures += Check(executor.blocking().num_threads() == 1 &&
+                          executor.blocking().max_threads() == 256,
+                      "the blocking pool is elastic by default");
+
+    auto on_cpu = executor.Submit(
+        [&executor] { return executor.cpu().CurrentWorkerIndex() >= 0; });
+    auto on_blocking = executor.SubmitBlocking(
+        [&executor] { return executor.blocking().CurrentWorkerIndex() >= 0; });
+    failures += Check(on_cpu.Get() && on_blocking.Get(),
+                      "Submit and SubmitBlocking run on their own pools");
+
+    // The calls only return if they all block at the same time.
+    std::atomic<int> arrived{0};
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    for (int i = 0; i < kBlockingCalls; ++i) {
+      executor.PostBlocking([&arrived, deadline] {
+        arrived.fetch_add(1);
+        while (arrived.load() < kBlockingCalls &&
+               std::chrono::steady_clock::now() < deadline) {
+          std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+      });
+    }
+    auto computed = executor.Submit([] { return 42; });
+    failures += Check(computed.Get() == 42,
+                      "CPU tasks run while blocking calls wait");
+    executor.WaitIdle();
+    failures += Check(arrived.load() == kBlockingCalls &&
+                          std::chrono::steady_clock::now() < deadline,
+                      "blocking calls make the blocking pool grow");
+
+    // CPU -> blocking -> CPU, all waited for by WaitIdle.
+    std::atomic<int> finished{0};
+    for (int i = 0; i < 100; ++i) {
+      executor.Post([&executor, &finished] {
+        executor.PostBlocking([&executor, &finished] {
+          std::this_thread::sleep_for(std::chrono::microseconds{100});
+          executor.Post([&finished] { finished.fetch_add(1); });
+        });
+      });
+    }
+    executor.WaitIdle();
+    failures += Check(finished.load() == 100,
+                      "WaitIdle waits for tasks handed between the pools");
+  }
+  {
+    tiny_tp::Executor executor;
+    std::atomic<bool> handed_back{false};
+    executor.PostBlocking([&executor, &handed_back] {
+      std::this_thread::sleep_for(std::chrono::milliseconds{50});
+      executor.Post([&handed_back] { handed_back.store(true); });
+    });
+    executor.Shutdown(tiny_tp::ShutdownMode::kDrain);
+    failures += Check(handed_back.load(),
+                      "work handed back to the stopped CPU pool still runs");
+  }
+  return failures == 0 ? 0 : 1;
+}
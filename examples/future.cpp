@@ -0,0 +1,106 @@
+/// @file future.cpp
+/// @brief An example that shows how to wait for the result of a specific task,
+/// and that misusing a `Promise` throws like `std::promise`
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/14
+
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+int Compute(int id, unsigned execution_time) {
+  std::printf("Task[%d] is executing (%u seconds)...\n", id, execution_time);
+  std::this_thread::sleep_for(std::chrono::seconds(execution_time));
+  return id;
+}
+
+/// @brief Returns whether `fn` throws a `std::future_error` with `code`.
+template <typename F>
+bool Throws(F fn, std::future_errc code) {
+  try {
+    fn();
+  } catch (const std::future_error& e) {
+    return e.code() == std::make_error_code(code);
+  }
+  return false;
+}
+
+static int kTaskSequence = 10000;
+static constexpr int kRounds = 3;
+int main(void) {
+  std::default_random_engine e;
+  std::uniform_int_distribution<unsigned> rt(1, 2);
+  std::uniform_int_distribution<unsigned> rc(3, 5);
+
+  tiny_tp::ThreadPool tp;
+  for (int round = 0; round < kRounds; ++round) {
+    unsigned task_cnt = rc(e);
+    std::vector<tiny_tp::Future<int>> futures;
+    for (unsigned i = 0; i < task_cnt; ++i) {
+      futures.push_back(tp.Submit(Compute, kTaskSequence++, rt(e)));
+    }
+    // Block on each task precisely instead of polling for results.
+    for (auto& future : futures) {
+      std::printf("Task[%d] is complete...\n", future.Get());
+    }
+    printf("\n");
+  }
+
+  int failures = 0;
+  {
+    tiny_tp::Promise<int> promise;
+    auto future = promise.GetFuture();
+    promise.SetValue(1);
+    failures += Check(
+        Throws([&] { promise.SetValue(2); },
+               std::future_errc::promise_already_satisfied) &&
+            Throws([&] {
+              promise.SetException(std::make_exception_ptr(1));
+            }, std::future_errc::promise_already_satisfied) &&
+            future.Get() == 1,
+        "setting a promise twice throws promise_already_satisfied");
+  }
+  {
+    tiny_tp::Promise<int> promise;
+    auto future = promise.GetFuture();
+    failures += Check(Throws([&] { promise.GetFuture(); },
+                             std::future_errc::future_already_retrieved),
+                      "a second GetFuture throws future_already_retrieved");
+  }
+  {
+    tiny_tp::Promise<int> promise;
+    promise.SetValue(3);
+    failures += Check(promise.GetFuture().Get() == 3,
+                      "GetFuture after SetValue still sees the value");
+  }
+  {
+    tiny_tp::Promise<int> promise;
+    tiny_tp::Promise<int> other{std::move(promise)};
+    failures += Check(
+        Throws([&] { promise.GetFuture(); }, std::future_errc::no_state) &&
+            Throws([&] { promise.SetValue(1); }, std::future_errc::no_state) &&
+            Throws([&] {
+              promise.SetException(std::make_exception_ptr(1));
+            }, std::future_errc::no_state),
+        "a moved-from promise throws no_state");
+  }
+  {
+    tiny_tp::Future<int> future;
+    {
+      tiny_tp::Promise<int> promise;
+      future = promise.GetFuture();
+    }
+    failures += Check(Throws([&] { future.Get(); },
+                             std::future_errc::broken_promise),
+                      "a destroyed promise breaks its future");
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+/// @file hooks.cpp
+/// @brief An example that sets up per-thread state with thread hooks, names
+/// the threads, and indexes per-thread slots with `CurrentWorkerIndex`
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+constexpr std::uint32_t kThreads = 4;
+constexpr int kTasks = 1000;
+
+/// @brief Index the start hook saw on this thread, -1 outside the pool.
+thread_local int hooked_index = -1;
+
+int main(void) {
+  int failures = 0;
+  std::atomic<std::uint32_t> started{0};
+  std::atomic<std::uint32_t> stopped{0};
+  std::vector<std::atomic<int>> starts(kThreads);
+  for (auto& count : starts) {
+    count.store(0);
+  }
+  std::atomic<int> mismatches{0};
+  {
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = kThreads;
+    options.thread_name = "hooks";
+    options.on_thread_start = [&](std::uint32_t index) {
+      hooked_index = static_cast<int>(index);
+      starts[index].fetch_add(1);
+      started.fetch_add(1);
+    };
+    options.on_thread_stop = [&](std::uint32_t index) {
+      if (hooked_index != static_cast<int>(index)) {
+        mismatches.fetch_add(1);
+      }
+      stopped.fetch_add(1);
+    };
+    tiny_tp::ThreadPool tp{options};
+    tiny_tp::ThreadPool other{1};
+
+    // Per-thread slots, written without locking.
+    std::vector<long long> slots(tp.max_threads(), 0);
+    for (int i = 0; i < kTasks; ++i) {
+      tp.Submit([&tp, &other, &slots, &mismatches, i] {
+        int index = tp.CurrentWorkerIndex();
+        if (index < 0 || index != hooked_index ||
+            other.CurrentWorkerIndex() != -1) {
+          mismatches.fetch_add(1);
+          return;
+        }
+        slots[index] += i;
+      });
+    }
+    tp.WaitIdle();
+    long long sum = 0;
+    for (long long slot : slots) {
+      sum += slot;
+    }
+    failures += Check(mismatches.load() == 0 &&
+                          sum == (kTasks - 1LL) * kTasks / 2,
+                      "CurrentWorkerIndex is the index the hooks see");
+    failures += Check(tp.CurrentWorkerIndex() == -1,
+                      "CurrentWorkerIndex is -1 outside the pool");
+#if defined(__linux__)
+    auto name = tp.Submit([] {
+      char buffer[16] = {};
+      pthread_getname_np(pthread_self(), buffer, sizeof(buffer));
+      return std::string{buffer};
+    }).Get();
+    failures += Check(name.compare(0, 6, "hooks-") == 0,
+                      "threads are named after thread_name");
+#endif
+  }
+  // Every thread has been joined by now.
+  bool started_once = started.load() == kThreads;
+  for (const auto& count : starts) {
+    started_once = started_once && count.load() == 1;
+  }
+  failures += Check(started_once, "on_thread_start runs once on every thread");
+  failures += Check(stopped.load() == kThreads && mismatches.load() == 0,
+                    "on_thread_stop runs once on every thread");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+/// @file lock_free.cpp
+/// @brief An example that runs the pool on the lock-free ring queue, chosen
+/// by option or by policy
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+using RingPool = tiny_tp::BasicThreadPool<tiny_tp::LockFreeQueue>;
+
+constexpr int kProducers = 4;
+constexpr int kTasksPerProducer = 5000;
+
+/// @brief Holds the only thread of `tp` until `open` is set.
+template <typename Pool>
+void Hold(Pool& tp, std::atomic<bool>& open) {
+  std::atomic<bool> started{false};
+  tp.Submit([&open, &started] {
+    started.store(true);
+    while (!open.load()) {
+      std::this_thread::yield();
+    }
+  });
+  while (!started.load()) {
+    std::this_thread::yield();
+  }
+}
+
+int main(void) {
+  int failures = 0;
+  {
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 4;
+    options.queue_backend = tiny_tp::QueueBackend::kLockFree;
+    tiny_tp::ThreadPool tp{options};
+    RingPool ring{4};
+    failures += Check(
+        tp.queue_backend() == tiny_tp::QueueBackend::kLockFree &&
+            ring.queue_backend() == tiny_tp::QueueBackend::kLockFree,
+        "the ring is chosen by option or by policy");
+
+    std::atomic<long long> sum{0};
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+      producers.emplace_back([&] {
+        for (int i = 0; i < kTasksPerProducer; ++i) {
+          while (!ring.Post([&sum, i] { sum.fetch_add(i); })) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+    for (auto& producer : producers) {
+      producer.join();
+    }
+    ring.WaitIdle();
+    failures += Check(sum.load() == kProducers * (kTasksPerProducer - 1LL) *
+                                        kTasksPerProducer / 2,
+                      "every task of concurrent producers runs once");
+  }
+  {
+    RingPool::Options options;
+    options.num_threads = 1;
+    options.max_queue_size = 3;
+    RingPool tp{options};
+    std::atomic<bool> open{false};
+    Hold(tp, open);
+    int added = 0;
+    for (int i = 0; i < 5; ++i) {
+      added += tp.Post([] {}) ? 1 : 0;
+    }
+    open.store(true);
+    tp.WaitIdle();
+    failures += Check(added == 3,
+                      "the ring holds max_queue_size tasks, not its rounded "
+                      "up size");
+  }
+  {
+    RingPool::Options options;
+    options.num_threads = 1;
+    options.priority_aging = std::chrono::steady_clock::duration::max();
+    RingPool tp{options};
+    std::atomic<bool> open{false};
+    Hold(tp, open);
+    std::mutex mtx;
+    std::string order;
+    auto record = [&mtx, &order](char name) {
+      std::lock_guard<std::mutex> guard{mtx};
+      order += name;
+    };
+    tp.Post(tiny_tp::Priority::kLow, record, 'l');
+    tp.Post(tiny_tp::Priority::kNormal, record, 'n');
+    tp.Post(tiny_tp::Priority::kHigh, record, 'h');
+    open.store(true);
+    tp.WaitIdle();
+    failures += Check(order == "hnl", "the ring dequeues by priority");
+  }
+  return failures == 0 ? 0 : 1;
+}
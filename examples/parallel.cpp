@@ -0,0 +1,99 @@
+/// @file parallel.cpp
+/// @brief An example that splits loops over a range with `ParallelFor` and
+/// `ParallelReduce`, and checks what a cancelling shutdown does to them
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/14
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+static std::atomic<int> visited{0};
+static void Visit(int) { ++visited; }
+static long long Widen(int i) { return i; }
+static long long Add(long long a, long long b) { return a + b; }
+
+// Pieces discarded by the shutdown fail the loop instead of hanging it,
+// whichever moment the shutdown hits.
+static bool ReturnsAfterCancel(bool reduce) {
+  auto slow = [](int) {
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+    return 1;
+  };
+  bool returned = true;
+  for (int round = 0; round < 50; ++round) {
+    tiny_tp::ThreadPool tp{8};
+    std::atomic<int> outcome{0};
+    std::thread caller{[&] {
+      try {
+        if (reduce) {
+          tp.ParallelReduce(
+              0, 2000, 0, slow, [](int a, int b) { return a + b; }, 1);
+        } else {
+          tp.ParallelFor(0, 2000, slow, 1);
+        }
+        outcome = 1;
+      } catch (const std::future_error&) {
+        outcome = 2;
+      }
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds(round % 10));
+    tp.Shutdown(tiny_tp::ShutdownMode::kCancelPending);
+    caller.join();
+    returned = returned && outcome != 0;
+  }
+  return returned;
+}
+
+int main(void) {
+  int failures = 0;
+  {
+    tiny_tp::ThreadPool tp{4};
+    std::vector<int> squares(100000);
+    tp.ParallelFor(0, static_cast<int>(squares.size()),
+                   [&](int i) { squares[i] = i % 1000 * (i % 1000); });
+    bool all = true;
+    for (int i = 0; i < static_cast<int>(squares.size()); ++i) {
+      all = all && squares[i] == i % 1000 * (i % 1000);
+    }
+    failures += Check(all, "ParallelFor covers the whole range");
+
+    long long sum = tp.ParallelReduce(
+        1, 100001, 0LL, [](int i) { return static_cast<long long>(i); },
+        [](long long a, long long b) { return a + b; });
+    failures += Check(sum == 5000050000LL, "ParallelReduce sums the range");
+
+    // A loop started from a task, the thread keeps helping while it waits.
+    auto nested = tp.Submit([&tp] {
+      std::atomic<int> count{0};
+      tp.ParallelFor(0, 10000, [&count](int) { ++count; }, 1);
+      return count.load();
+    });
+    failures += Check(nested.Get() == 10000, "ParallelFor inside a task");
+
+    // Const callables and plain functions are taken as they are.
+    std::atomic<int> count{0};
+    const auto increment = [&count](int) { ++count; };
+    tp.ParallelFor(0, 1000, increment);
+    failures += Check(count == 1000, "ParallelFor with a const lambda");
+    tp.ParallelFor(0, 1000, Visit);
+    failures += Check(visited == 1000, "ParallelFor with a function");
+    const auto widen = [](int i) { return static_cast<long long>(i); };
+    const auto add = [](long long a, long long b) { return a + b; };
+    failures += Check(tp.ParallelReduce(1, 1001, 0LL, widen, add) == 500500 &&
+                          tp.ParallelReduce(1, 1001, 0LL, Widen, Add) == 500500,
+                      "ParallelReduce with const lambdas and functions");
+  }
+  failures += Check(ReturnsAfterCancel(false),
+                    "ParallelFor returns after kCancelPending");
+  failures += Check(ReturnsAfterCancel(true),
+                    "ParallelReduce returns after kCancelPending");
+  return failures == 0 ? 0 : 1;
+}
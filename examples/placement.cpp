@@ -0,0 +1,94 @@
+/// @file placement.cpp
+/// @brief An example that pins the threads of a pool to CPUs and spreads
+/// them over the NUMA nodes
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+/// @brief Returns the CPUs the calling thread may run on, empty if unknown.
+std::vector<unsigned> AllowedCpus() {
+  std::vector<unsigned> cpus;
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  return cpus;
+}
+
+/// @brief Runs `tasks` tasks on `tp`.
+/// @return The number of them whose thread was not pinned to a single CPU,
+/// or to `cpu` if it is not negative.
+int CountUnpinned(tiny_tp::ThreadPool& tp, int tasks, int cpu) {
+  std::atomic<int> unpinned{0};
+  for (int i = 0; i < tasks; ++i) {
+    tp.Submit([&unpinned, cpu] {
+      auto allowed = AllowedCpus();
+      bool pinned = allowed.size() == 1 &&
+                    (cpu < 0 || allowed.front() == static_cast<unsigned>(cpu));
+      unpinned.fetch_add(pinned ? 0 : 1);
+    });
+  }
+  tp.WaitIdle();
+  return unpinned.load();
+}
+
+int main(void) {
+  int failures = 0;
+  {
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 4;
+    options.placement = tiny_tp::Placement::kNumaNodes;
+    tiny_tp::ThreadPool tp{options};
+    std::atomic<int> ran{0};
+    for (int i = 0; i < 1000; ++i) {
+      tp.Submit([&ran] { ran.fetch_add(1); });
+    }
+    tp.WaitIdle();
+    failures += Check(ran.load() == 1000,
+                      "tasks run on a pool spread over the NUMA nodes");
+  }
+#if defined(__linux__)
+  auto cpus = AllowedCpus();
+  if (!cpus.empty()) {
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 2;
+    options.placement = tiny_tp::Placement::kCpuList;
+    options.cpus = {cpus.front()};
+    tiny_tp::ThreadPool tp{options};
+    failures += Check(
+        CountUnpinned(tp, 100, static_cast<int>(cpus.front())) == 0,
+        "kCpuList pins every thread to its CPU");
+  }
+  // Without a known topology, the threads are not pinned.
+  if (!tiny_tp::detail::PhysicalCores().empty()) {
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 2;
+    options.placement = tiny_tp::Placement::kPhysicalCores;
+    tiny_tp::ThreadPool tp{options};
+    failures += Check(CountUnpinned(tp, 100, -1) == 0,
+                      "kPhysicalCores pins every thread to one CPU");
+  }
+  failures += Check(tiny_tp::detail::ParseCpuList("0-3,8,10-11") ==
+                        std::vector<unsigned>{0, 1, 2, 3, 8, 10, 11},
+                    "kernel CPU lists are parsed");
+#endif
+  return failures == 0 ? 0 : 1;
+}
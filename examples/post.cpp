@@ -0,0 +1,104 @@
+/// @file post.cpp
+/// @brief An example that posts fire-and-forget tasks and waits for them as
+/// a whole with a `TaskGroup`
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+constexpr int kTasks = 1000;
+
+int main(void) {
+  int failures = 0;
+  {
+    tiny_tp::ThreadPool tp{4};
+    std::atomic<int> count{0};
+    for (int i = 0; i < kTasks; ++i) {
+      tp.Post([&count](int n) { count.fetch_add(n); }, 1);
+    }
+    tp.WaitIdle();
+    failures += Check(count.load() == kTasks, "posted callables run");
+
+    tiny_tp::TaskGroup group;
+    for (int round = 0; round < 2; ++round) {
+      count.store(0);
+      for (int i = 0; i < kTasks; ++i) {
+        tp.Post(group, [&count] { count.fetch_add(1); });
+      }
+      group.Wait();
+      failures += Check(count.load() == kTasks && group.pending() == 0,
+                        round == 0 ? "TaskGroup::Wait waits for every task"
+                                   : "a TaskGroup is reusable once empty");
+    }
+
+    for (int i = 0; i < 10; ++i) {
+      tp.Post(group, [i] {
+        if (i % 2 == 1) {
+          throw std::runtime_error{"task failed"};
+        }
+      });
+    }
+    bool thrown = false;
+    try {
+      group.Wait();
+    } catch (const std::runtime_error& e) {
+      thrown = std::string{e.what()} == "task failed";
+    }
+    bool cleared = true;
+    try {
+      group.Wait();
+    } catch (...) {
+      cleared = false;
+    }
+    failures += Check(thrown && cleared,
+                      "Wait rethrows the first exception of the group once");
+  }
+  {
+    // A task of a one-thread pool waits for its children.
+    tiny_tp::ThreadPool tp{1};
+    std::atomic<int> count{0};
+    auto parent = tp.Submit([&tp, &count] {
+      tiny_tp::TaskGroup children;
+      for (int i = 0; i < 10; ++i) {
+        tp.Post(children, [&count] { count.fetch_add(1); });
+      }
+      tp.WaitFor(children);
+      return count.load();
+    });
+    failures += Check(parent.Get() == 10,
+                      "WaitFor runs the tasks of the group meanwhile");
+  }
+  {
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 1;
+    options.max_queue_size = 1;
+    tiny_tp::ThreadPool tp{options};
+    std::atomic<bool> open{false};
+    std::atomic<bool> started{false};
+    tp.Post([&open, &started] {
+      started.store(true);
+      while (!open.load()) {
+        std::this_thread::yield();
+      }
+    });
+    while (!started.load()) {
+      std::this_thread::yield();
+    }
+    tiny_tp::TaskGroup group;
+    bool first = tp.Post(group, [] {});
+    bool second = tp.Post(group, [] {});
+    failures += Check(first && !second && group.pending() == 1,
+                      "a rejected task leaves its group");
+    open.store(true);
+    group.Wait();
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+/// @file priority.cpp
+/// @brief An example where queued tasks are dequeued by priority, and
+/// waiting tasks age into the next more urgent level
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+/// @brief A one-thread pool whose thread is held by a task until `Release`,
+/// so that the order of the tasks queued meanwhile can be observed.
+class Recorder {
+ public:
+  explicit Recorder(std::chrono::steady_clock::duration aging) {
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 1;
+    options.priority_aging = aging;
+    tp_.reset(new tiny_tp::ThreadPool{options});
+    tp_->Submit([this] {
+      started_.store(true);
+      while (!released_.load()) {
+        std::this_thread::yield();
+      }
+    });
+    while (!started_.load()) {
+      std::this_thread::yield();
+    }
+  }
+  void Add(tiny_tp::Priority priority, char name) {
+    tp_->Submit(priority, [this, name] {
+      std::lock_guard<std::mutex> guard{mtx_};
+      order_ += name;
+    });
+  }
+  std::string Release() {
+    released_.store(true);
+    tp_->WaitIdle();
+    return order_;
+  }
+
+ private:
+  std::unique_ptr<tiny_tp::ThreadPool> tp_;
+  std::atomic<bool> started_{false};
+  std::atomic<bool> released_{false};
+  std::mutex mtx_;
+  std::string order_;
+};
+
+int main(void) {
+  int failures = 0;
+  {
+    Recorder recorder{std::chrono::steady_clock::duration::max()};
+    recorder.Add(tiny_tp::Priority::kLow, 'l');
+    recorder.Add(tiny_tp::Priority::kNormal, 'n');
+    recorder.Add(tiny_tp::Priority::kHigh, 'h');
+    recorder.Add(tiny_tp::Priority::kNormal, 'N');
+    recorder.Add(tiny_tp::Priority::kHigh, 'H');
+    failures += Check(recorder.Release() == "hHnNl",
+                      "tasks are dequeued by priority, FIFO within a level");
+  }
+  {
+    Recorder recorder{std::chrono::milliseconds{10}};
+    recorder.Add(tiny_tp::Priority::kLow, 'l');
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    recorder.Add(tiny_tp::Priority::kNormal, 'n');
+    failures += Check(recorder.Release() == "ln",
+                      "an aged low task overtakes a fresh normal one");
+  }
+  {
+    Recorder recorder{std::chrono::milliseconds{10}};
+    recorder.Add(tiny_tp::Priority::kNormal, 'n');
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    recorder.Add(tiny_tp::Priority::kHigh, 'h');
+    failures += Check(recorder.Release() == "nh",
+                      "an aged normal task overtakes a fresh high one");
+  }
+  {
+    Recorder recorder{std::chrono::steady_clock::duration::max()};
+    recorder.Add(tiny_tp::Priority::kLow, 'l');
+    std::this_thread::sleep_for(std::chrono::milliseconds{50});
+    recorder.Add(tiny_tp::Priority::kNormal, 'n');
+    failures += Check(recorder.Release() == "nl",
+                      "tasks never age with aging disabled");
+  }
+  return failures == 0 ? 0 : 1;
+}
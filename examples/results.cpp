@@ -0,0 +1,118 @@
+/// @file results.cpp
+/// @brief An example that drains the results every thread collects in a
+/// buffer of its own, into one vector or into one vector per buffer
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+class IdTask : public tiny_tp::ITask {
+ public:
+  explicit IdTask(int id) : id_{id} {}
+  std::shared_ptr<void> Execute() override {
+    return std::make_shared<int>(id_);
+  }
+
+ private:
+  int id_;
+};
+
+constexpr int kTasks = 1000;
+constexpr long long kIdSum = static_cast<long long>(kTasks) * (kTasks - 1) / 2;
+
+long long SumIds(const std::vector<std::shared_ptr<void>>& results) {
+  long long sum = 0;
+  for (const auto& result : results) {
+    sum += *std::static_pointer_cast<int>(result);
+  }
+  return sum;
+}
+
+void DropAll(tiny_tp::ThreadPool& tp) {
+  for (int i = 0; i < kTasks; ++i) {
+    tp.DropWait(std::make_shared<IdTask>(i));
+  }
+  tp.WaitIdle();
+}
+
+int main(void) {
+  int failures = 0;
+  tiny_tp::ThreadPool tp{4};
+
+  DropAll(tp);
+  failures += Check(tp.QueryResultsCount() == kTasks,
+                    "QueryResultsCount counts the results of every thread");
+  std::vector<std::shared_ptr<void>> results;
+  std::size_t count = tp.GrabAllResults(results);
+  failures += Check(count == kTasks && results.size() == kTasks &&
+                        SumIds(results) == kIdSum,
+                    "GrabAllResults into one vector takes every result once");
+  failures += Check(tp.QueryResultsCount() == 0 &&
+                        tp.GrabAllResults(results) == 0,
+                    "a drained pool has no results left");
+
+  DropAll(tp);
+  std::vector<std::vector<std::shared_ptr<void>>> shards;
+  count = tp.GrabAllResults(shards);
+  long long sum = 0;
+  std::size_t total = 0;
+  for (const auto& shard : shards) {
+    sum += SumIds(shard);
+    total += shard.size();
+  }
+  failures += Check(shards.size() == tp.max_threads() + 1 &&
+                        count == kTasks && total == kTasks && sum == kIdSum,
+                    "GrabAllResults into one vector per buffer");
+
+  // Slots cleared for reuse are swapped with the buffers of the threads.
+  for (auto& shard : shards) {
+    shard.clear();
+  }
+  DropAll(tp);
+  total = 0;
+  for (const auto& shard : shards) {
+    total += shard.size();
+  }
+  count = tp.GrabAllResults(shards);
+  for (const auto& shard : shards) {
+    total += shard.size();
+  }
+  failures += Check(total == kTasks && count == kTasks &&
+                        tp.QueryResultsCount() == 0,
+                    "reused slots take every result once");
+
+  {
+    // The results of tasks run outside the pool land in the last slot.
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 1;
+    options.max_queue_size = 1;
+    options.overflow_policy = tiny_tp::OverflowPolicy::kCallerRuns;
+    tiny_tp::ThreadPool caller_runs{options};
+    std::atomic<bool> release{false};
+    caller_runs.Submit([&release] {
+      while (!release.load()) {
+        std::this_thread::yield();
+      }
+    });
+    // The thread is busy or about to be, so the queue is full by the third.
+    for (int i = 0; i < 3; ++i) {
+      caller_runs.Drop(std::make_shared<IdTask>(i));
+    }
+    release.store(true);
+    caller_runs.WaitIdle();
+    std::vector<std::vector<std::shared_ptr<void>>> caller_shards;
+    caller_runs.GrabAllResults(caller_shards);
+    failures += Check(!caller_shards.back().empty(),
+                      "results of tasks run by the caller go to the last slot");
+  }
+  return failures == 0 ? 0 : 1;
+}
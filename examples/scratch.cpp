@@ -0,0 +1,71 @@
+/// @file scratch.cpp
+/// @brief An example where tasks take temporary buffers from the scratch
+/// arena of their thread, which is rewound after every task
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+constexpr std::size_t kHuge{100 * 1024 * 1024};
+
+int main(void) {
+  int failures = 0;
+  {
+    tiny_tp::ThreadPool tp{1};
+    auto sum = tp.Submit([](std::size_t n) {
+      auto& scratch = tiny_tp::ThreadPool::Scratch();
+      std::vector<std::size_t, tiny_tp::ScratchAllocator<std::size_t>> values{
+          tiny_tp::ScratchAllocator<std::size_t>(scratch)};
+      for (std::size_t i = 0; i < n; ++i) {
+        values.push_back(i);
+      }
+      std::size_t total = 0;
+      for (auto value : values) {
+        total += value;
+      }
+      return total;
+    }, std::size_t{100000});
+    failures += Check(sum.Get() == std::size_t{100000} * 99999 / 2,
+                      "vector on the scratch arena");
+  }
+  {
+    // Several chunks are merged into one of at most kMaxRetainedSize.
+    tiny_tp::ScratchArena arena;
+    arena.Allocate(10);
+    std::memset(arena.Allocate(kHuge), 0, kHuge);
+    arena.Reset();
+    failures += Check(
+        arena.capacity() <= tiny_tp::ScratchArena::kMaxRetainedSize,
+        "several chunks shrink on Reset");
+  }
+  {
+    // So is a single chunk that a huge first allocation made.
+    tiny_tp::ScratchArena arena;
+    std::memset(arena.Allocate(kHuge), 0, kHuge);
+    arena.Reset();
+    failures += Check(
+        arena.capacity() <= tiny_tp::ScratchArena::kMaxRetainedSize,
+        "a single huge chunk shrinks on Reset");
+  }
+  {
+    // The arena of a pool thread is rewound after the task that grew it.
+    tiny_tp::ThreadPool tp{1};
+    tp.Submit([] {
+      auto& scratch = tiny_tp::ThreadPool::Scratch();
+      std::memset(scratch.Allocate(kHuge), 0, kHuge);
+    }).Get();
+    auto kept = tp.Submit([] {
+      return tiny_tp::ThreadPool::Scratch().capacity();
+    });
+    failures += Check(kept.Get() <= tiny_tp::ScratchArena::kMaxRetainedSize,
+                      "pool threads do not keep huge chunks");
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+/// @file spawn.cpp
+/// @brief An example that runs coroutines on pools with `Spawn` and moves
+/// them between pools with `Schedule`, needs C++20
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/14
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+#if TINY_TP_COROUTINES
+// Counts the frames alive, to see that discarded coroutines are freed.
+static std::atomic<int> alive{0};
+struct Alive {
+  Alive() { ++alive; }
+  ~Alive() { --alive; }
+};
+
+static tiny_tp::Task<int> Square(tiny_tp::ThreadPool& tp, int n) {
+  Alive frame;
+  co_await tp.Schedule();
+  co_return n * n;
+}
+
+static tiny_tp::Task<int> SumOfSquares(tiny_tp::ThreadPool& tp, int n) {
+  Alive frame;
+  int sum = 0;
+  for (int i = 1; i <= n; ++i) {
+    sum += co_await Square(tp, i);
+  }
+  co_return sum;
+}
+
+static tiny_tp::Task<void> Fail() {
+  throw std::runtime_error{"failed"};
+  co_return;
+}
+
+static bool IsBroken(tiny_tp::Future<int>& future) {
+  if (!future.WaitFor(std::chrono::seconds(5))) {
+    return false;
+  }
+  try {
+    future.Get();
+  } catch (const std::future_error&) {
+    return true;
+  }
+  return false;
+}
+
+int main(void) {
+  int failures = 0;
+  {
+    tiny_tp::ThreadPool tp{4};
+    auto sum = tp.Spawn(SumOfSquares(tp, 10));
+    failures += Check(sum.Get() == 385, "Spawn runs nested tasks");
+
+    auto fail = tp.Spawn(Fail());
+    bool thrown = false;
+    try {
+      fail.Get();
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    failures += Check(thrown, "Spawn forwards exceptions");
+  }
+  {
+    // The only thread is busy, so the spawned coroutine is still queued when
+    // the pool discards it.
+    tiny_tp::ThreadPool tp{1};
+    tiny_tp::Promise<void> gate;
+    auto blocked = gate.GetFuture();
+    tp.Submit([&blocked] { blocked.Wait(); });
+    auto sum = tp.Spawn(SumOfSquares(tp, 10));
+    std::thread stopper{
+        [&tp] { tp.Shutdown(tiny_tp::ShutdownMode::kCancelPending); }};
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.SetValue();
+    stopper.join();
+    failures += Check(IsBroken(sum) && alive == 0,
+                      "Spawn fails after kCancelPending");
+  }
+  {
+    // Discarded while an inner task waits to move to another pool.
+    tiny_tp::ThreadPool home{1};
+    tiny_tp::ThreadPool away{1};
+    tiny_tp::Promise<void> gate;
+    auto blocked = gate.GetFuture();
+    away.Submit([&blocked] { blocked.Wait(); });
+    auto sum = home.Spawn(SumOfSquares(away, 10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::thread stopper{
+        [&away] { away.Shutdown(tiny_tp::ShutdownMode::kCancelPending); }};
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.SetValue();
+    stopper.join();
+    failures += Check(IsBroken(sum) && alive == 0,
+                      "Spawn frees nested tasks after kCancelPending");
+  }
+  return failures == 0 ? 0 : 1;
+}
+#else
+int main(void) {
+  std::printf("skipped: coroutines need C++20\n");
+  return 0;
+}
+#endif  // TINY_TP_COROUTINES
@@ -0,0 +1,105 @@
+/// @file stats.cpp
+/// @brief An example that reads the counters and latency histograms of a
+/// pool, collected with the `CollectStats` policy
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+using StatsPool = tiny_tp::BasicThreadPool<
+    tiny_tp::OptionsQueue, tiny_tp::KeepResults, tiny_tp::OptionsIdle,
+    tiny_tp::CollectStats>;
+using PlainPool = tiny_tp::BasicThreadPool<
+    tiny_tp::OptionsQueue, tiny_tp::KeepResults, tiny_tp::OptionsIdle,
+    tiny_tp::NoStats>;
+
+constexpr int kTasks = 100;
+constexpr std::chrono::milliseconds kRunTime{1};
+
+/// @brief Runs `kTasks` tasks of `kRunTime` each on `tp`.
+template <typename Pool>
+void RunTasks(Pool& tp) {
+  for (int i = 0; i < kTasks; ++i) {
+    tp.Submit([] { std::this_thread::sleep_for(kRunTime); });
+  }
+  tp.WaitIdle();
+}
+
+int main(void) {
+  int failures = 0;
+  {
+    StatsPool tp{2};
+    RunTasks(tp);
+    auto stats = tp.Stats();
+    std::uint64_t executed = 0;
+    for (const auto& worker : stats.workers) {
+      executed += worker.tasks_executed;
+    }
+    failures += Check(stats.total.tasks_executed == kTasks &&
+                          executed == kTasks,
+                      "executed tasks are counted per thread and in total");
+    failures += Check(stats.run_time.count() == kTasks &&
+                          stats.wait_time.count() == kTasks,
+                      "every task records its wait and run time");
+    failures += Check(stats.run_time.Percentile(0.5) >= kRunTime / 2 &&
+                          stats.run_time.max() >= kRunTime,
+                      "run times are measured");
+    failures += Check(stats.threads == 2 && stats.workers.size() == 2 &&
+                          stats.queued_tasks == 0,
+                      "the snapshot reports threads and queued tasks");
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    failures += Check(tp.Stats().total.parks > 0, "idle threads park");
+  }
+  {
+    StatsPool::Options options;
+    options.num_threads = 1;
+    options.max_queue_size = 1;
+    StatsPool tp{options};
+    std::atomic<bool> open{false};
+    std::atomic<bool> started{false};
+    tp.Submit([&open, &started] {
+      started.store(true);
+      while (!open.load()) {
+        std::this_thread::yield();
+      }
+    });
+    while (!started.load()) {
+      std::this_thread::yield();
+    }
+    tp.Submit([] {});
+    tp.Submit([] {});
+    tp.Submit([] {});
+    open.store(true);
+    tp.WaitIdle();
+    failures += Check(tp.Stats().rejected == 2,
+                      "tasks rejected by a full queue are counted");
+  }
+  {
+    PlainPool tp{2};
+    RunTasks(tp);
+    auto stats = tp.Stats();
+    failures += Check(stats.total.tasks_executed == 0 &&
+                          stats.run_time.count() == 0 && stats.threads == 2,
+                      "NoStats collects no counters but reports the threads");
+  }
+  {
+    tiny_tp::Histogram histogram;
+    for (std::uint64_t ns = 1; ns <= 1000; ++ns) {
+      histogram.Record(ns * 1000);
+    }
+    auto median = histogram.Percentile(0.5).count();
+    failures += Check(histogram.count() == 1000 &&
+                          histogram.max().count() == 1000000 &&
+                          histogram.Mean().count() == 500500 &&
+                          median > 450000 && median <= 500000,
+                      "histograms keep count, max, mean and percentiles");
+  }
+  return failures == 0 ? 0 : 1;
+}
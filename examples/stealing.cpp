@@ -0,0 +1,90 @@
+/// @file stealing.cpp
+/// @brief An example where tasks spawn tasks into the local deque of their
+/// thread and idle threads steal them
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+using StatsPool = tiny_tp::BasicThreadPool<
+    tiny_tp::OptionsQueue, tiny_tp::KeepResults, tiny_tp::OptionsIdle,
+    tiny_tp::CollectStats>;
+
+constexpr int kThreads = 4;
+constexpr int kChildren = 64;
+constexpr int kDepth = 10;
+
+/// @brief Spawns a binary tree of tasks below `depth`, counting them.
+void Spawn(StatsPool* tp, std::atomic<int>* count, int depth) {
+  count->fetch_add(1);
+  if (depth == 0) {
+    return;
+  }
+  for (int i = 0; i < 2; ++i) {
+    tp->Submit(Spawn, tp, count, depth - 1);
+  }
+}
+
+int main(void) {
+  int failures = 0;
+  StatsPool::Options options;
+  options.num_threads = kThreads;
+  options.scheduling = tiny_tp::Scheduling::kWorkStealing;
+  {
+    // All children go to the deque of the thread that runs the root, the
+    // other threads only get them by stealing.
+    StatsPool tp{options};
+    std::atomic<int> ran{0};
+    std::vector<std::atomic<bool>> ran_on(kThreads);
+    for (auto& flag : ran_on) {
+      flag.store(false);
+    }
+    tp.Submit([&] {
+      for (int i = 0; i < kChildren; ++i) {
+        tp.Submit([&] {
+          ran_on[tp.CurrentWorkerIndex()].store(true);
+          std::this_thread::sleep_for(std::chrono::milliseconds(2));
+          ran.fetch_add(1);
+        });
+      }
+    });
+    tp.WaitIdle();
+    int threads = 0;
+    for (const auto& flag : ran_on) {
+      threads += flag.load() ? 1 : 0;
+    }
+    failures += Check(ran.load() == kChildren, "every spawned task runs");
+    failures += Check(threads > 1, "spawned tasks spread over the threads");
+    failures += Check(tp.Stats().total.steals > 0, "steals are counted");
+  }
+  {
+    StatsPool tp{options};
+    std::atomic<int> count{0};
+    tp.Submit(Spawn, &tp, &count, kDepth);
+    tp.WaitIdle();
+    failures += Check(count.load() == (1 << (kDepth + 1)) - 1,
+                      "a recursively spawned tree runs completely");
+  }
+  {
+    StatsPool tp{options};
+    std::vector<tiny_tp::Future<int>> futures;
+    for (int i = 0; i < 1000; ++i) {
+      futures.push_back(tp.Submit([](int n) { return n; }, i));
+    }
+    long long sum = 0;
+    for (auto& future : futures) {
+      sum += future.Get();
+    }
+    failures += Check(sum == 999LL * 1000 / 2,
+                      "tasks from other threads go through the shared queue");
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+/// @file strand.cpp
+/// @brief An example where strands run the tasks of one key in order on a
+/// shared pool, without a thread of their own
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+constexpr int kStrands = 4;
+constexpr int kTasksPerStrand = 5000;
+
+/// @brief What the tasks of one strand saw.
+struct Log {
+  std::vector<int> order;
+  std::atomic<int> running{0};
+  std::atomic<bool> overlapped{false};
+};
+
+void Append(Log* log, int value) {
+  if (log->running.fetch_add(1) != 0) {
+    log->overlapped.store(true);
+  }
+  log->order.push_back(value);
+  log->running.fetch_sub(1);
+}
+
+bool InOrder(const Log& log) {
+  if (log.order.size() != static_cast<std::size_t>(kTasksPerStrand)) {
+    return false;
+  }
+  for (int i = 0; i < kTasksPerStrand; ++i) {
+    if (log.order[i] != i) {
+      return false;
+    }
+  }
+  return !log.overlapped.load();
+}
+
+int main(void) {
+  int failures = 0;
+  tiny_tp::ThreadPool tp{4};
+  for (std::size_t batch_size : {std::size_t{1}, std::size_t{64}}) {
+    // One producer thread per strand, all strands sharing the pool.
+    std::vector<Log> logs(kStrands);
+    std::vector<std::unique_ptr<tiny_tp::Strand>> strands;
+    std::vector<std::thread> producers;
+    for (int s = 0; s < kStrands; ++s) {
+      strands.emplace_back(new tiny_tp::Strand{tp, batch_size});
+    }
+    for (int s = 0; s < kStrands; ++s) {
+      producers.emplace_back([&, s] {
+        for (int i = 0; i < kTasksPerStrand; ++i) {
+          strands[s]->Submit(Append, &logs[s], i);
+        }
+      });
+    }
+    for (auto& producer : producers) {
+      producer.join();
+    }
+    bool ok = true;
+    for (int s = 0; s < kStrands; ++s) {
+      strands[s]->WaitIdle();
+      ok = ok && InOrder(logs[s]);
+    }
+    failures += Check(ok, batch_size == 1
+                              ? "strands run in order, one task per hand-off"
+                              : "strands run in order, in batches");
+  }
+  {
+    tiny_tp::Strand strand{tp};
+    auto answer = strand.Submit([](int n) { return n * 2; }, 21);
+    failures += Check(answer.Get() == 42,
+                      "Submit to a strand returns a Future");
+  }
+  {
+    // A rejected strand runs its tasks on the calling thread.
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 1;
+    options.max_queue_size = 1;
+    tiny_tp::ThreadPool full{options};
+    std::atomic<bool> open{false};
+    std::atomic<bool> started{false};
+    full.Submit([&open, &started] {
+      started.store(true);
+      while (!open.load()) {
+        std::this_thread::yield();
+      }
+    });
+    while (!started.load()) {
+      std::this_thread::yield();
+    }
+    full.Submit([] {});
+    tiny_tp::Strand strand{full};
+    auto ran_on = strand.Submit([] { return std::this_thread::get_id(); });
+    bool here = ran_on.IsReady() && ran_on.Get() == std::this_thread::get_id();
+    open.store(true);
+    full.WaitIdle();
+    failures += Check(here, "a rejected strand runs on the calling thread");
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+/// @file task_graph.cpp
+/// @brief An example that runs tasks with dependencies as a `TaskGraph`, and
+/// checks what a cancelling shutdown does to a run
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/14
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+int main(void) {
+  int failures = 0;
+  {
+    // load -> (parse, index) -> store, run a few times.
+    tiny_tp::ThreadPool tp{4};
+    tiny_tp::TaskGraph graph;
+    std::atomic<int> step{0};
+    int loaded = -1, parsed = -1, indexed = -1, stored = -1;
+    auto& load = graph.Emplace([&] { loaded = step++; });
+    auto& parse = graph.Emplace([&] { parsed = step++; });
+    auto& index = graph.Emplace([&] { indexed = step++; });
+    auto& store = graph.Emplace([&] { stored = step++; });
+    load.Precede(parse).Precede(index);
+    store.Succeed(parse).Succeed(index);
+    bool ordered = true;
+    for (int run = 0; run < 100; ++run) {
+      step = 0;
+      graph.Run(tp).Get();
+      ordered = ordered && loaded == 0 && parsed > 0 && indexed > 0 &&
+                stored == 3;
+    }
+    failures += Check(ordered, "TaskGraph respects the dependencies");
+
+    tiny_tp::TaskGraph failing;
+    bool skipped = true;
+    auto& first = failing.Emplace([] { throw std::runtime_error{"first"}; });
+    failing.Emplace([&skipped] { skipped = false; }).Succeed(first);
+    bool thrown = false;
+    try {
+      failing.Run(tp).Get();
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    failures += Check(thrown && skipped, "TaskGraph stops at an exception");
+  }
+  {
+    // The only thread is busy, so the roots are still queued when the pool
+    // discards them.
+    tiny_tp::ThreadPool tp{1};
+    tiny_tp::Promise<void> gate;
+    auto blocked = gate.GetFuture();
+    tp.Submit([&blocked] { blocked.Wait(); });
+    tiny_tp::TaskGraph graph;
+    bool ran = false;
+    auto& root = graph.Emplace([&ran] { ran = true; });
+    graph.Emplace([&ran] { ran = true; }).Succeed(root);
+    auto done = graph.Run(tp);
+    std::thread stopper{
+        [&tp] { tp.Shutdown(tiny_tp::ShutdownMode::kCancelPending); }};
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.SetValue();
+    stopper.join();
+    bool broken = false;
+    if (done.WaitFor(std::chrono::seconds(5))) {
+      try {
+        done.Get();
+      } catch (const std::future_error&) {
+        broken = true;
+      }
+    }
+    failures += Check(broken && !ran, "TaskGraph fails after kCancelPending");
+  }
+  return failures == 0 ? 0 : 1;
+}
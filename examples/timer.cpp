@@ -7,38 +7,43 @@
 
 #include <chrono>
 #include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "../tiny_tp.hpp"
 
-class ITimerTask : public tiny_tp::ITask {
+class CommonTimer {
  public:
-  ITimerTask(unsigned times, long long interval)
-      : times_{times}, interval_{interval} {}
-  std::shared_ptr<void> Execute() final {
-    std::chrono::milliseconds elapse{interval_};
-    for (unsigned i = 0; i < times_; ++i) {
-      std::this_thread::sleep_for(elapse);
-      OnTimerTick(i + 1);
-    }
-    return nullptr;
+  CommonTimer(unsigned id, unsigned times) : id_{id}, times_{times} {}
+  /// @brief Ticks every `period` on `tp`, until `times` ticks or `Stop`.
+  template <typename Rep, typename Period>
+  void Start(tiny_tp::ThreadPool& tp,
+             const std::chrono::duration<Rep, Period>& period) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    handle_ = tp.ScheduleEvery(period, [this] { OnTimerTick(); });
+  }
+  /// @brief Stops ticking, a tick already running is not waited for.
+  void Stop() {
+    std::lock_guard<std::mutex> guard{mtx_};
+    handle_.Cancel();
   }
-  virtual void OnTimerTick(unsigned tick_count) = 0;
-
- protected:
-  const unsigned times_;
-  const long long interval_;
-};
 
-class CommonTimer : public ITimerTask {
- public:
-  CommonTimer(unsigned id, unsigned times, long long interval)
-      : ITimerTask{times, interval}, id_{id} {}
-  void OnTimerTick(unsigned tick_count) final {
+ private:
+  /// @brief Called by the pool on every tick, cancels the timer on the last.
+  void OnTimerTick() {
+    unsigned tick_count = ++tick_count_;
     std::printf("task[%2u] %2u/%2u(p/t)\n", id_, tick_count, times_);
+    if (tick_count == times_) {
+      Stop();
+    }
   }
 
- private:
-  unsigned id_;
+  const unsigned id_;
+  const unsigned times_;
+  unsigned tick_count_{0};
+  std::mutex mtx_;
+  tiny_tp::Timer handle_;
 };
 
 void ShowInfo(tiny_tp::ThreadPool& tp);
@@ -46,15 +51,25 @@ void ShowInfo(tiny_tp::ThreadPool& tp);
 int main(void) {
   tiny_tp::ThreadPool tp;
   ShowInfo(tp);
-  std::this_thread::sleep_for(std::chrono::seconds(3));
+  std::vector<std::unique_ptr<CommonTimer>> timers;
   for (unsigned i = 0; i < 12; ++i) {
-    tp.Drop(std::make_shared<CommonTimer>(i, (i + 1) * 2, 2000));
+    timers.emplace_back(new CommonTimer{i, (i + 1) * 2});
+    // Pending ticks do not occupy any thread of the pool.
+    timers.back()->Start(tp, std::chrono::seconds(2));
   }
-  while (true) {
+  tp.ScheduleAfter(std::chrono::seconds(5),
+                   []() { std::printf("five seconds passed\n"); });
+  for (unsigned second = 0; second < 30; ++second) {
     ShowInfo(tp);
     std::this_thread::sleep_for(std::chrono::seconds(1));
     std::printf("\n");
   }
+  for (auto& timer : timers) {
+    timer->Stop();
+  }
+  // A tick may still be queued or running, it must end before its timer is
+  // destroyed.
+  tp.WaitIdle();
   return 0;
 }
 
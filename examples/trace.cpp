@@ -0,0 +1,78 @@
+/// @file trace.cpp
+/// @brief An example that records what the threads do and writes it as a
+/// Chrome trace, with tasks named by `TraceLabel`
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/15
+
+#define TINY_TP_TRACE 1
+
+#include <sstream>
+#include <string>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+/// @brief Counts the occurrences of `what` in `text`.
+std::size_t Count(const std::string& text, const std::string& what) {
+  std::size_t count = 0;
+  for (auto pos = text.find(what); pos != std::string::npos;
+       pos = text.find(what, pos + what.size())) {
+    ++count;
+  }
+  return count;
+}
+
+std::string Trace(tiny_tp::ThreadPool& tp) {
+  std::ostringstream out;
+  tp.WriteTrace(out);
+  return out.str();
+}
+
+int main(void) {
+  int failures = 0;
+  {
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 2;
+    options.thread_name = "traced";
+    tiny_tp::ThreadPool tp{options};
+    {
+      tiny_tp::TraceLabel label{"decode"};
+      for (int i = 0; i < 10; ++i) {
+        // The nested task inherits the label of the one submitting it.
+        tp.Submit([&tp] { tp.Submit([] {}); });
+      }
+    }
+    tp.Submit([] {});
+    tp.WaitIdle();
+    auto trace = Trace(tp);
+    const std::string head{"{\"displayTimeUnit\":\"ns\",\"traceEvents\":["};
+    failures += Check(trace.compare(0, head.size(), head) == 0 &&
+                          trace.compare(trace.size() - 2, 2, "]}") == 0,
+                      "the trace is a Chrome trace JSON object");
+    failures += Check(Count(trace, "\"traced-0\"") == 1 &&
+                          Count(trace, "\"traced-1\"") == 1,
+                      "every thread has a named track");
+    failures += Check(
+        Count(trace, "{\"name\":\"decode\",\"cat\":\"task\"") == 20 &&
+            Count(trace, "{\"name\":\"task\",\"cat\":\"task\"") == 1,
+        "tasks are named after the label they were submitted or run under");
+    failures += Check(Count(trace, "\"cat\":\"queue\",\"ph\":\"b\"") == 21 &&
+                          Count(trace, "\"cat\":\"queue\",\"ph\":\"e\"") == 21,
+                      "the time every task waited is a slice of its own");
+  }
+  {
+    tiny_tp::ThreadPool::Options options;
+    options.num_threads = 1;
+    options.trace_capacity = 4;
+    tiny_tp::ThreadPool tp{options};
+    for (int i = 0; i < 100; ++i) {
+      tp.Submit([] {});
+    }
+    tp.WaitIdle();
+    failures += Check(Count(Trace(tp), "\"cat\":\"task\"") == 4,
+                      "threads keep their latest trace_capacity events");
+  }
+  return failures == 0 ? 0 : 1;
+}
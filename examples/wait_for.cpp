@@ -0,0 +1,111 @@
+/// @file wait_for.cpp
+/// @brief An example where tasks wait for other tasks with `WaitFor`, which
+/// keeps their threads busy with queued tasks instead of blocking them
+/// @version 1.0.0
+/// @copyright MIT License
+/// @author Lau0120
+/// @date 2026/10/14
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+
+#include "../tiny_tp.hpp"
+#include "check.hpp"
+
+// Waits for tasks it submitted itself, which a single thread could not do
+// without `WaitFor`.
+static int Fibonacci(tiny_tp::ThreadPool& tp, int n) {
+  if (n < 2) {
+    return n;
+  }
+  auto left = tp.Submit(Fibonacci, std::ref(tp), n - 1);
+  int right = Fibonacci(tp, n - 2);
+  tp.WaitFor(left);
+  return left.Get() + right;
+}
+
+int main(void) {
+  int failures = 0;
+  {
+    tiny_tp::ThreadPool tp{1};
+    auto fib = tp.Submit(Fibonacci, std::ref(tp), 15);
+    failures += Check(fib.Get() == 610, "nested WaitFor on one thread");
+  }
+  {
+    // Threads of two pools wait for the same future, and the future
+    // outlives the pools of its waiters.
+    bool woke = true;
+    for (int round = 0; round < 100; ++round) {
+      tiny_tp::Promise<int> promise;
+      auto future = promise.GetFuture();
+      std::unique_ptr<tiny_tp::ThreadPool> first{new tiny_tp::ThreadPool{1}};
+      std::unique_ptr<tiny_tp::ThreadPool> second{new tiny_tp::ThreadPool{1}};
+      auto a = first->Submit([&] {
+        first->WaitFor(future);
+        return future.IsReady();
+      });
+      auto b = second->Submit([&] {
+        second->WaitFor(future);
+        return future.IsReady();
+      });
+      std::this_thread::sleep_for(std::chrono::microseconds(round * 10));
+      promise.SetValue(round);
+      woke = woke && a.WaitFor(std::chrono::seconds(5)) &&
+             b.WaitFor(std::chrono::seconds(5)) && a.Get() && b.Get() &&
+             future.Get() == round;
+      // The first pool may be gone while the promise still notifies.
+      first.reset();
+      second.reset();
+    }
+    failures += Check(woke, "WaitFor from two pools");
+  }
+  {
+    // A task discarded by the shutdown of its pool breaks its future, and
+    // tasks of other pools waiting for it carry on.
+    tiny_tp::ThreadPool waiter{1};
+    std::unique_ptr<tiny_tp::ThreadPool> doomed{new tiny_tp::ThreadPool{1}};
+    tiny_tp::Promise<void> gate;
+    auto blocked = gate.GetFuture();
+    doomed->Submit([&blocked] { blocked.Wait(); });
+    auto discarded = doomed->Submit([] { return 1; });
+    auto outcome = waiter.Submit([&] {
+      waiter.WaitFor(discarded);
+      try {
+        return discarded.Get();
+      } catch (const std::future_error&) {
+        return -1;
+      }
+    });
+    std::thread stopper{
+        [&doomed] { doomed->Shutdown(tiny_tp::ShutdownMode::kCancelPending); }};
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    gate.SetValue();
+    stopper.join();
+    failures += Check(outcome.WaitFor(std::chrono::seconds(5)) &&
+                          outcome.Get() == -1,
+                      "WaitFor returns after kCancelPending");
+  }
+  {
+    // A rejected submission reports it instead of crashing its caller.
+    tiny_tp::ThreadPool tp{1};
+    tp.Shutdown(tiny_tp::ShutdownMode::kDrain);
+    auto rejected = tp.Submit([] { return 1; });
+    int errors = 0;
+    try {
+      rejected.Get();
+    } catch (const std::future_error& error) {
+      errors += error.code() == std::future_errc::no_state ? 1 : 0;
+    }
+    try {
+      tiny_tp::ThreadPool other{1};
+      other.Submit([&] { other.WaitFor(rejected); }).Get();
+    } catch (const std::future_error& error) {
+      errors += error.code() == std::future_errc::no_state ? 1 : 0;
+    }
+    failures += Check(!rejected.valid() && errors == 2,
+                      "rejected Submit throws no_state");
+  }
+  return failures == 0 ? 0 : 1;
+}
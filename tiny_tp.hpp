@@ -9,16 +9,94 @@
 #define TINY_TP_HPP_
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <limits>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <string>
 #include <thread>
-#include <unordered_map>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+// Define as 1 to make `ThreadPool` collect the counters and histograms of
+// `ThreadPool::Stats`, which cost nothing otherwise. Selects `DefaultStats`,
+// other pools choose with their `StatsPolicy`. Must have the same value in
+// every translation unit of a program, see `TINY_TP_ABI`.
+#ifndef TINY_TP_STATS
+#define TINY_TP_STATS 0
+#endif
+
+// Define as 1 to record the tasks every thread runs for
+// `ThreadPool::WriteTrace`, which costs nothing otherwise. Must have the same
+// value in every translation unit of a program, see `TINY_TP_ABI`.
+#ifndef TINY_TP_TRACE
+#define TINY_TP_TRACE 0
+#endif
+
+// Coroutine support (`ThreadPool::Schedule`, `Task`) is enabled for C++20
+// compilers that provide <coroutine>. Define as 0 to leave it out.
+#ifndef TINY_TP_COROUTINES
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && \
+    defined(__has_include)
+#if __has_include(<coroutine>)
+#define TINY_TP_COROUTINES 1
+#endif
+#endif
+#endif
+#ifndef TINY_TP_COROUTINES
+#define TINY_TP_COROUTINES 0
+#endif
+
+// Everything is defined in an inline namespace named after the macros that
+// change the layout of the types, so that translation units including this
+// header with different values fail to link against each other instead of
+// silently sharing types that differ.
+#if TINY_TP_STATS && TINY_TP_TRACE
+#define TINY_TP_ABI stats1_trace1
+#elif TINY_TP_STATS
+#define TINY_TP_ABI stats1_trace0
+#elif TINY_TP_TRACE
+#define TINY_TP_ABI stats0_trace1
+#else
+#define TINY_TP_ABI stats0_trace0
+#endif
+
+#if TINY_TP_COROUTINES
+#include <coroutine>
+#include <optional>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+
+#include <fstream>
+#endif
+
+#if defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#endif
+
 namespace tiny_tp {  // definitions
+inline namespace TINY_TP_ABI {
 
 /// @brief Interface for tasks to be executed by the `ThreadPool`.
 class ITask {
@@ -26,144 +104,5798 @@ class ITask {
   virtual std::shared_ptr<void> Execute() = 0;
 };
 
-/// @brief A thread pool class for executing tasks concurrently.
-class ThreadPool {
+/// @brief How the `ThreadPool` distributes tasks among its threads.
+enum class Scheduling {
+  /// @brief Every thread takes tasks from one shared FIFO queue.
+  kGlobalQueue,
+  /// @brief Every thread owns a local deque and steals from the others.
+  kWorkStealing,
+};
+
+/// @brief Priority levels of tasks in the `ThreadPool` queue.
+enum class Priority : std::uint8_t {
+  /// @brief Latency-critical tasks, dequeued before all others.
+  kHigh,
+  /// @brief The default.
+  kNormal,
+  /// @brief Background tasks, dequeued when nothing else is waiting, or once
+  /// they have aged enough.
+  kLow,
+};
+
+/// @brief What `ThreadPool::Shutdown` does with tasks that have not started.
+enum class ShutdownMode {
+  /// @brief Run every queued task, including tasks they submit, first.
+  kDrain,
+  /// @brief Discard queued tasks, their futures report a broken promise.
+  kCancelPending,
+};
+
+/// @brief What a thread of the `ThreadPool` does when it runs out of tasks.
+enum class IdlePolicy {
+  /// @brief Block right away, cheapest on CPU.
+  kBlock,
+  /// @brief Busy-wait for a bounded number of CPU pause instructions, then
+  /// block.
+  kSpin,
+  /// @brief Busy-wait, then keep yielding the CPU for a while, then block.
+  kSpinYieldPark,
+};
+
+/// @brief Implementation of the shared task queue of a `ThreadPool`.
+enum class QueueBackend {
+  /// @brief Mutex-protected deques, memory grows and shrinks with the queue.
+  kLocked,
+  /// @brief Lock-free rings preallocated for `max_queue_size` tasks per
+  /// priority level, no locking nor allocation after construction.
+  kLockFree,
+};
+
+/// @brief Where the threads of a `ThreadPool` run.
+enum class Placement {
+  /// @brief Wherever the OS schedules them.
+  kAny,
+  /// @brief Thread `i` is pinned to `Options::cpus[i % cpus.size()]`.
+  kCpuList,
+  /// @brief Thread `i` is pinned to one logical CPU of the `i`-th physical
+  /// core, wrapping around.
+  kPhysicalCores,
+  /// @brief Threads are spread over the NUMA nodes and pinned to the CPUs of
+  /// their node. Every node has a shared queue of its own, and threads only
+  /// take tasks of other nodes when their node has none.
+  kNumaNodes,
+};
+
+/// @brief What adding a task to a full queue of a `ThreadPool` does.
+enum class OverflowPolicy {
+  /// @brief The task is rejected.
+  kReject,
+  /// @brief The calling thread runs the task right away, which throttles
+  /// producers and keeps recursive workloads going.
+  kCallerRuns,
+};
+
+template <typename QueuePolicy, typename TaskPolicy, typename IdleStrategy,
+          typename StatsPolicy>
+class BasicThreadPool;
+
+namespace detail {
+
+/// @brief Hints the CPU that the caller is busy-waiting.
+inline void CpuRelax() {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+/// @brief Reads the time stamp counter of the CPU, or a steady clock in
+/// nanoseconds where it has none. Cheaper than `steady_clock::now()`.
+inline std::uint64_t ReadTsc() {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  return __rdtsc();
+#elif defined(__i386__) || defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+  std::uint64_t ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+#endif
+}
+
+/// @brief Assumed size of a cache line.
+constexpr std::size_t kCacheLineSize{64};
+
+/// @brief Keeps `value` on a cache line of its own, so that writes to it do
+/// not slow down threads reading neighbouring data.
+template <typename T>
+struct CacheLinePadded {
+  char padding_before[kCacheLineSize];
+  T value;
+  char padding_after[kCacheLineSize - sizeof(T) % kCacheLineSize];
+};
+
+#if defined(__linux__)
+/// @brief Parses a kernel CPU list such as "0-3,8,10-11".
+inline std::vector<unsigned> ParseCpuList(const std::string& list) {
+  std::vector<unsigned> cpus;
+  std::size_t pos = 0;
+  while (pos < list.size()) {
+    std::size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    std::string range = list.substr(pos, end - pos);
+    std::size_t dash = range.find('-');
+    try {
+      auto first = static_cast<unsigned>(std::stoul(range.substr(0, dash)));
+      auto last = dash == std::string::npos
+                      ? first
+                      : static_cast<unsigned>(std::stoul(range.substr(dash + 1)));
+      for (unsigned cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    } catch (const std::exception&) {
+      return {};
+    }
+    pos = end + 1;
+  }
+  return cpus;
+}
+inline std::vector<unsigned> ReadCpuList(const std::string& path) {
+  std::ifstream file{path};
+  std::string list;
+  if (!std::getline(file, list)) {
+    return {};
+  }
+  return ParseCpuList(list);
+}
+/// @brief Removes the CPUs the process may not run on from `cpus`.
+inline void KeepAllowedCpus(std::vector<unsigned>& cpus) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return;
+  }
+  cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                            [&allowed](unsigned cpu) {
+                              return cpu >= CPU_SETSIZE ||
+                                     !CPU_ISSET(cpu, &allowed);
+                            }),
+             cpus.end());
+}
+#endif
+
+/// @brief Returns the CPUs of every NUMA node the process may run on, or a
+/// single empty set if the topology is unknown.
+inline std::vector<std::vector<unsigned>> NumaNodes() {
+  std::vector<std::vector<unsigned>> nodes;
+#if defined(__linux__)
+  const std::string root{"/sys/devices/system/node/"};
+  for (unsigned node : ReadCpuList(root + "online")) {
+    auto cpus = ReadCpuList(root + "node" + std::to_string(node) + "/cpulist");
+    KeepAllowedCpus(cpus);
+    if (!cpus.empty()) {
+      nodes.push_back(std::move(cpus));
+    }
+  }
+#endif
+  if (nodes.empty()) {
+    nodes.emplace_back();
+  }
+  return nodes;
+}
+/// @brief Returns one logical CPU of every physical core the process may run
+/// on, empty if the topology is unknown.
+inline std::vector<unsigned> PhysicalCores() {
+  std::vector<unsigned> cores;
+#if defined(__linux__)
+  const std::string root{"/sys/devices/system/cpu/"};
+  auto cpus = ReadCpuList(root + "online");
+  KeepAllowedCpus(cpus);
+  for (unsigned cpu : cpus) {
+    auto siblings = ReadCpuList(root + "cpu" + std::to_string(cpu) +
+                                "/topology/thread_siblings_list");
+    KeepAllowedCpus(siblings);
+    // The first allowed hyper-thread stands for its core.
+    if (siblings.empty() || siblings.front() == cpu) {
+      cores.push_back(cpu);
+    }
+  }
+#endif
+  return cores;
+}
+/// @brief Restricts the calling thread to `cpus`, if supported.
+/// @return False if the thread could not be pinned.
+inline bool PinThisThread(const std::vector<unsigned>& cpus) {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return CPU_COUNT(&set) != 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+/// @brief Names the calling thread for debuggers and profilers, if
+/// supported. Linux keeps the first 15 characters.
+inline void NameThisThread(const std::string& name) {
+#if defined(__linux__)
+  pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#elif defined(__APPLE__)
+  pthread_setname_np(name.c_str());
+#else
+  (void)name;
+#endif
+}
+/// @brief Returns the CPU the caller is running on, -1 if unknown.
+inline int CurrentCpu() {
+#if defined(__linux__)
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+/// @brief Parks threads until notified without losing wake-ups.
+///
+/// A waiter calls `PrepareWait`, re-checks its condition and then either
+/// `CancelWait` or `Wait`. A notifier changes the condition first and then
+/// calls `Notify`, which only touches the mutex when someone is waiting.
+class EventCount {
  public:
-  /// @brief Default maximum queue size for the `ThreadPool`.
-  static constexpr std::uint32_t kDefaultMaxQueueSize{65535};
+  /// @brief Changes every time `Notify` is called, so busy-waiters can
+  /// detect new work without registering as waiters.
+  std::uint64_t Epoch() const { return epoch_.load(std::memory_order_acquire); }
+  std::uint64_t PrepareWait() {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    // Pairs with the fence in `HasWaiters`.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_seq_cst);
+  }
+  void CancelWait() { waiters_.fetch_sub(1, std::memory_order_seq_cst); }
+  void Wait(std::uint64_t key) {
+    std::unique_lock<std::mutex> unique_lock{mtx_};
+    cond_.wait(unique_lock, [this, key]() {
+      return epoch_.load(std::memory_order_seq_cst) != key;
+    });
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+  /// @return False if `deadline` passed before a notification.
+  bool WaitUntil(std::uint64_t key,
+                 const std::chrono::steady_clock::time_point& deadline) {
+    std::unique_lock<std::mutex> unique_lock{mtx_};
+    bool notified = cond_.wait_until(unique_lock, deadline, [this, key]() {
+      return epoch_.load(std::memory_order_seq_cst) != key;
+    });
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+    return notified;
+  }
+  /// @brief Lets a notifier that has just changed the condition skip
+  /// `Notify` when nobody waits. Do not use when busy-waiters rely on
+  /// `Epoch`.
+  bool HasWaiters() const {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return waiters_.load(std::memory_order_relaxed) != 0;
+  }
+  void NotifyOne() { Notify(1); }
+  void NotifyAll() { Notify(std::numeric_limits<std::size_t>::max()); }
+  /// @brief Wakes up to `count` waiters.
+  void Notify(std::size_t count) {
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+    std::size_t waiters = waiters_.load(std::memory_order_seq_cst);
+    if (waiters == 0 || count == 0) {
+      return;
+    }
+    // Serialize with a waiter that is between its check and its sleep.
+    { std::lock_guard<std::mutex> guard{mtx_}; }
+    if (count >= waiters) {
+      cond_.notify_all();
+    } else {
+      for (std::size_t i = 0; i < count; ++i) {
+        cond_.notify_one();
+      }
+    }
+  }
 
-  /// @brief Constructs a `ThreadPool` with specified number of threads and
-  /// maximum queue size.
-  /// @param num_threads The number of threads in the `ThreadPool`.
-  /// @param max_queue_size The maximum size of the task queue.
-  ThreadPool(std::uint32_t num_threads, std::uint32_t max_queue_size)
-      : kNumThreads{num_threads}, kMaxQueueSize{max_queue_size},
-        exit_mark_{new std::uint32_t{0}} {
-    std::lock_guard<std::mutex> threads_idle_guard(threads_idle_mtx_);
-    // Create the specified number of threads and start them.
-    for (std::uint32_t i = 0; i < kNumThreads; ++i) {
-      auto thread = std::thread(&ThreadPool::Cycle, this);
-      threads_idle_[thread.get_id()] = true;
-      thread.detach();
+ private:
+  std::atomic<std::uint64_t> epoch_{0};
+  std::atomic<std::uint32_t> waiters_{0};
+  std::mutex mtx_;
+  std::condition_variable cond_;
+};
+
+/// @brief Event counts to notify once something completes, one per thread
+/// that waits for it while it runs other tasks. Entries live on the stack of
+/// their threads, and the list is guarded by the lock of its owner, which
+/// notifies while holding it, so a removed entry is never touched again.
+class WakerList {
+ public:
+  struct Entry {
+    explicit Entry(EventCount* waker) : event{waker} {}
+    EventCount* event;
+    Entry* next{nullptr};
+  };
+
+  void Add(Entry* entry) {
+    entry->next = head_;
+    head_ = entry;
+  }
+  void Remove(Entry* entry) {
+    for (Entry** link = &head_; *link != nullptr; link = &(*link)->next) {
+      if (*link == entry) {
+        *link = entry->next;
+        return;
+      }
     }
   }
-  ThreadPool()
-      : ThreadPool{std::thread::hardware_concurrency(), kDefaultMaxQueueSize} {}
-  explicit ThreadPool(std::uint32_t num_threads)
-      : ThreadPool{num_threads, kDefaultMaxQueueSize} {};
-  ~ThreadPool() {
-    // Terminate threads one by one.
-    for (std::uint32_t i = 0; i < kNumThreads; ++i) {
-      // Send quit "signal" to each thread.
-      Drop(std::make_shared<QuitTask>(exit_mark_));
-      while (*exit_mark_ != i + 1) {
-        // Reschedule execution of threads (lower the priority of main thread)
-        std::this_thread::yield();
+  void NotifyAll() {
+    for (Entry* entry = head_; entry != nullptr; entry = entry->next) {
+      entry->event->NotifyAll();
+    }
+  }
+
+ private:
+  Entry* head_{nullptr};
+};
+
+/// @brief Compile-time integer sequence, `std::index_sequence` is C++14.
+template <std::size_t... Is>
+struct IndexSequence {};
+template <std::size_t N, std::size_t... Is>
+struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, Is...> {};
+template <std::size_t... Is>
+struct MakeIndexSequence<0, Is...> {
+  using Type = IndexSequence<Is...>;
+};
+
+/// @brief A callable bundled with the arguments it is invoked with.
+template <typename F, typename... Args>
+class BoundCall {
+ public:
+  template <typename G, typename... Ts>
+  explicit BoundCall(G&& fn, Ts&&... args)
+      : fn_{std::forward<G>(fn)}, args_{std::forward<Ts>(args)...} {}
+  auto operator()() -> decltype(std::declval<F&>()(std::declval<Args&>()...)) {
+    return Call(typename MakeIndexSequence<sizeof...(Args)>::Type{});
+  }
+
+ private:
+  template <std::size_t... Is>
+  auto Call(IndexSequence<Is...>)
+      -> decltype(std::declval<F&>()(std::declval<Args&>()...)) {
+    return fn_(std::get<Is>(args_)...);
+  }
+
+  F fn_;
+  std::tuple<Args...> args_;
+};
+
+/// @brief Binds `fn` to `args` by value, or returns `fn` itself when there
+/// are no arguments.
+template <typename F>
+typename std::decay<F>::type Bind(F&& fn) {
+  return std::forward<F>(fn);
+}
+template <typename F, typename Arg, typename... Args>
+BoundCall<typename std::decay<F>::type, typename std::decay<Arg>::type,
+          typename std::decay<Args>::type...>
+Bind(F&& fn, Arg&& arg, Args&&... args) {
+  return BoundCall<typename std::decay<F>::type, typename std::decay<Arg>::type,
+                   typename std::decay<Args>::type...>{
+      std::forward<F>(fn), std::forward<Arg>(arg), std::forward<Args>(args)...};
+}
+
+/// @brief Per-thread free lists of memory blocks in size classes of
+/// `kGranule` bytes up to `kMaxBlockSize`, so that task nodes, result states
+/// and timers are recycled without going through the global allocator.
+///
+/// A block returns to the thread that allocated it. Freed there, it joins a
+/// free list directly; freed on another thread, it is pushed onto a
+/// lock-free stack of its owner, which takes the whole stack back the next
+/// time a free list runs dry. So producers get back the blocks their
+/// consumers free. Every list caches at most `kMaxCached` blocks and returns
+/// the rest to the allocator, as does a thread on exit, blocks freed after
+/// that go to the allocator too. Larger or over-aligned blocks go to the
+/// allocator directly.
+class BlockPool {
+ public:
+  static constexpr std::size_t kGranule{64};
+  static constexpr std::size_t kNumClasses{8};
+  static constexpr std::size_t kMaxBlockSize{kGranule * kNumClasses};
+  static constexpr std::size_t kMaxCached{256};
+
+  static void* Allocate(std::size_t size,
+                        std::size_t align = alignof(std::max_align_t)) {
+    if (align > alignof(std::max_align_t)) {
+#ifdef __cpp_aligned_new
+      return ::operator new(size, std::align_val_t{align});
+#else
+      return ::operator new(size);
+#endif
+    }
+    if (size > kMaxBlockSize) {
+      return ::operator new(size);
+    }
+    std::size_t size_class = ClassOf(size);
+    Cache* cache = LocalCache();
+    Owner* owner = nullptr;
+    if (cache != nullptr) {
+      List& list = cache->lists[size_class];
+      if (list.head == nullptr) {
+        Reclaim(*cache);
       }
+      if (list.head != nullptr) {
+        Block* block = list.head;
+        list.head = block->next;
+        --list.count;
+        return block;
+      }
+      owner = cache->owner;
+      owner->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Always the full class size, since the block is cached later.
+    void* raw = ::operator new(kHeaderSize + (size_class + 1) * kGranule);
+    ::new (raw) Header{owner, size_class};
+    return static_cast<char*>(raw) + kHeaderSize;
+  }
+  static void Deallocate(void* pointer, std::size_t size,
+                         std::size_t align = alignof(std::max_align_t)) {
+    if (align > alignof(std::max_align_t)) {
+#ifdef __cpp_aligned_new
+      ::operator delete(pointer, std::align_val_t{align});
+#else
+      ::operator delete(pointer);
+#endif
+      return;
+    }
+    if (size > kMaxBlockSize) {
+      ::operator delete(pointer);
+      return;
     }
+    Owner* owner = HeaderOf(pointer)->owner;
+    if (owner == nullptr) {
+      Free(pointer);
+      return;
+    }
+    Cache* cache = LocalCache();
+    if (cache != nullptr && cache->owner == owner) {
+      Cache::Put(cache->lists[ClassOf(size)], pointer);
+      return;
+    }
+    // Freed away from its owner, handed back through the stack.
+    Block* block = ::new (pointer) Block{nullptr};
+    Block* head = owner->remote.load(std::memory_order_relaxed);
+    do {
+      if (head == Closed()) {
+        Free(pointer);
+        return;
+      }
+      block->next = head;
+    } while (!owner->remote.compare_exchange_weak(
+        head, block, std::memory_order_release, std::memory_order_relaxed));
   }
 
-  /// @brief Adds a task to the `ThreadPool` queue (non-blocking).
-  /// @param task The task to be added to the queue.
-  /// @return True if the task was successfully added, false otherwise.
-  bool Drop(std::shared_ptr<ITask> task) {
-    std::lock_guard<std::mutex> waiting_queue_guard{waiting_queue_mtx_};
-    if (waiting_queue_.size() >= kMaxQueueSize) {
-      return false;
+ private:
+  struct Block {
+    Block* next;
+  };
+  struct List {
+    Block* head{nullptr};
+    std::size_t count{0};
+  };
+  /// @brief Shared with the blocks of a thread, so that they find their way
+  /// back, and freed with the last of them.
+  struct Owner {
+    /// @brief Blocks freed on other threads, `Closed` once the thread exits.
+    std::atomic<Block*> remote{nullptr};
+    /// @brief One for the cache of the thread, one for each block.
+    std::atomic<std::size_t> refs{1};
+  };
+  /// @brief Precedes every block of a size class.
+  struct Header {
+    Owner* owner;
+    std::size_t size_class;
+  };
+  static constexpr std::size_t kHeaderSize{alignof(std::max_align_t)};
+  static_assert(sizeof(Header) <= kHeaderSize, "header too large");
+
+  enum CacheState { kUnused, kLive, kGone };
+  struct Cache {
+    explicit Cache(CacheState* state) : state{state}, owner{new Owner} {
+      *state = kLive;
     }
-    waiting_queue_.push(task);
-    waiting_queue_cond_.notify_one();
-    return true;
+    ~Cache() {
+      for (auto& list : lists) {
+        FreeAll(list.head);
+      }
+      FreeAll(owner->remote.exchange(Closed(), std::memory_order_acquire));
+      *state = kGone;
+      Release(owner);
+    }
+    /// @brief Caches the block at `pointer` in `list`, or frees it if full.
+    static void Put(List& list, void* pointer) {
+      if (list.count == kMaxCached) {
+        Free(pointer);
+        return;
+      }
+      list.head = ::new (pointer) Block{list.head};
+      ++list.count;
+    }
+    CacheState* state;
+    Owner* const owner;
+    List lists[kNumClasses];
+  };
+
+  static std::size_t ClassOf(std::size_t size) {
+    return size == 0 ? 0 : (size - 1) / kGranule;
   }
-  /// @brief Retrieves all results from the `ThreadPool` queue (non-blocking).
-  /// @return A vector containing all results from executed tasks.
-  std::vector<std::shared_ptr<void>> GrabAllResults() {
-    std::vector<std::shared_ptr<void>> results;
-    std::lock_guard<std::mutex> results_queue_guard{results_queue_mtx_};
-    while (!results_queue_.empty()) {
-      results.push_back(results_queue_.front());
-      results_queue_.pop();
+  static Header* HeaderOf(void* pointer) {
+    return reinterpret_cast<Header*>(static_cast<char*>(pointer) -
+                                     kHeaderSize);
+  }
+  /// @brief Marks the stack of an owner whose thread has exited.
+  static Block* Closed() {
+    static Block closed{nullptr};
+    return &closed;
+  }
+  static void Release(Owner* owner) {
+    if (owner->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete owner;
     }
-    return results;
   }
-  [[nodiscard]] std::uint32_t max_queue_size() const { return kMaxQueueSize; }
-  [[nodiscard]] std::uint32_t num_threads() const { return kNumThreads; }
-  size_t QueryIdleThreadsCount() {
-    std::lock_guard<std::mutex> threads_idle_guard{threads_idle_mtx_};
-    return std::count_if(
-        threads_idle_.cbegin(), threads_idle_.cend(),
-        [](const std::pair<std::thread::id, bool>& e) { return e.second; });
+  /// @brief Returns a block of a size class to the allocator.
+  static void Free(void* pointer) {
+    Owner* owner = HeaderOf(pointer)->owner;
+    ::operator delete(HeaderOf(pointer));
+    if (owner != nullptr) {
+      Release(owner);
+    }
   }
-  size_t QueryWaitingQueueCount() {
-    std::lock_guard<std::mutex> waiting_queue_guard{waiting_queue_mtx_};
-    return waiting_queue_.size();
+  static void FreeAll(Block* block) {
+    while (block != nullptr) {
+      Block* next = block->next;
+      Free(block);
+      block = next;
+    }
   }
-  size_t QueryResultsCount() {
-    std::lock_guard<std::mutex> results_queue_guard{results_queue_mtx_};
-    return results_queue_.size();
+  /// @brief Takes back the blocks of `cache` freed on other threads.
+  static void Reclaim(Cache& cache) {
+    std::atomic<Block*>& remote = cache.owner->remote;
+    if (remote.load(std::memory_order_relaxed) == nullptr) {
+      return;
+    }
+    Block* block = remote.exchange(nullptr, std::memory_order_acquire);
+    while (block != nullptr) {
+      Block* next = block->next;
+      Cache::Put(cache.lists[HeaderOf(block)->size_class], block);
+      block = next;
+    }
+  }
+  /// @return The cache of the calling thread, null while the thread exits.
+  static Cache* LocalCache() {
+    // Trivially destructible, so it stays valid while the destructors of
+    // other thread-local objects free blocks.
+    static thread_local CacheState state{kUnused};
+    if (state == kGone) {
+      return nullptr;
+    }
+    static thread_local Cache cache{&state};
+    return &cache;
+  }
+};
+
+/// @brief Class-specific allocation functions of `T` served by `BlockPool`.
+template <typename T>
+struct Pooled {
+  static void* operator new(std::size_t size) {
+    return BlockPool::Allocate(size, alignof(T));
+  }
+  static void operator delete(void* pointer, std::size_t size) {
+    BlockPool::Deallocate(pointer, size, alignof(T));
+  }
+};
+
+}  // namespace detail
+
+/// @brief Standard allocator drawing from the per-thread block pools of the
+/// `ThreadPool`. Blocks freed on another thread go back to the thread that
+/// allocated them.
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(
+        detail::BlockPool::Allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T* pointer, std::size_t n) noexcept {
+    detail::BlockPool::Deallocate(pointer, n * sizeof(T), alignof(T));
+  }
+};
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept {
+  return false;
+}
+
+/// @brief Like `std::make_shared`, but the object and its control block are
+/// allocated with a `PoolAllocator`. Creating tasks and their results this
+/// way recycles their memory among the threads instead of calling `malloc`.
+template <typename T, typename... Args>
+std::shared_ptr<T> MakeShared(Args&&... args) {
+  return std::allocate_shared<T>(PoolAllocator<T>{},
+                                 std::forward<Args>(args)...);
+}
+
+namespace detail {
+
+/// @brief Move-only, type-erased `void()` callable with small-buffer storage.
+///
+/// Callables of up to `kInlineSize` bytes that are nothrow movable live inside
+/// the object itself, so a lambda capturing a few pointers never allocates.
+/// Larger callables fall back to the heap, and like the nodes of the
+/// work-stealing deques they are allocated from the `BlockPool`.
+class TaskFunction : public Pooled<TaskFunction> {
+ public:
+  static constexpr std::size_t kInlineSize{6 * sizeof(void*)};
+
+  TaskFunction() = default;
+  template <typename F,
+            typename = typename std::enable_if<!std::is_base_of<
+                TaskFunction, typename std::decay<F>::type>::value>::type>
+  TaskFunction(F&& fn) {  // NOLINT(runtime/explicit)
+    Construct<typename std::decay<F>::type>(std::forward<F>(fn));
+  }
+  TaskFunction(TaskFunction&& other) noexcept { MoveFrom(other); }
+  TaskFunction& operator=(TaskFunction&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      MoveFrom(other);
+    }
+    return *this;
+  }
+  TaskFunction(const TaskFunction&) = delete;
+  TaskFunction& operator=(const TaskFunction&) = delete;
+  ~TaskFunction() { Reset(); }
+
+  void operator()() { ops_->invoke(&storage_); }
+  explicit operator bool() const { return ops_ != nullptr; }
+  /// @brief The stored callable if it is an `F`, null otherwise, like
+  /// `std::function::target`.
+  template <typename F>
+  F* Target() {
+    return Target<F>(FitsInline<F>{});
+  }
+  void Reset() {
+    if (ops_ != nullptr) {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
   }
 
  private:
-  /// @brief A special task used to signal thread termination.
-  class QuitTask : public ITask {
-   public:
-    QuitTask(std::shared_ptr<std::uint32_t> mark) : exit_mark_{mark} {}
-    std::shared_ptr<void> Execute() override { return exit_mark_; }
+  using Storage =
+      typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type;
 
-   private:
-    std::shared_ptr<std::uint32_t> exit_mark_;
+  struct Ops {
+    void (*invoke)(Storage*);
+    /// @brief Move-constructs into `dst` and destroys `src`.
+    void (*relocate)(Storage* dst, Storage* src);
+    void (*destroy)(Storage*);
   };
 
-  /// @brief Main function for thread pool execution cycle.
-  void Cycle() {
-    // Main loop for each thread.
-    while (true) {
-      // Try to take a task from queue.
-      std::unique_lock<std::mutex> waiting_queue_unique_lock{waiting_queue_mtx_};
-      // Keep waiting until the queue is not empty.
-      waiting_queue_cond_.wait(waiting_queue_unique_lock,
-                               [this]() { return !waiting_queue_.empty(); });
-      // Update thread to non-idle state.
-      std::unique_lock<std::mutex> threads_idle_unique_lock{threads_idle_mtx_};
-      threads_idle_[std::this_thread::get_id()] = false;
-      threads_idle_unique_lock.unlock();
+  template <typename F>
+  struct InlineOps {
+    static F* Get(Storage* s) { return reinterpret_cast<F*>(s); }
+    static void Invoke(Storage* s) { (*Get(s))(); }
+    static void Relocate(Storage* dst, Storage* src) {
+      ::new (static_cast<void*>(dst)) F(std::move(*Get(src)));
+      Get(src)->~F();
+    }
+    static void Destroy(Storage* s) { Get(s)->~F(); }
+    static const Ops* Table() {
+      static const Ops ops{&Invoke, &Relocate, &Destroy};
+      return &ops;
+    }
+  };
+  /// @brief Heap storage of a callable that does not fit inline.
+  template <typename F>
+  struct Box : Pooled<Box<F>> {
+    template <typename G>
+    explicit Box(G&& fn) : fn{std::forward<G>(fn)} {}
+    F fn;
+  };
+  template <typename F>
+  struct HeapOps {
+    static Box<F>*& Get(Storage* s) { return *reinterpret_cast<Box<F>**>(s); }
+    static void Invoke(Storage* s) { Get(s)->fn(); }
+    static void Relocate(Storage* dst, Storage* src) {
+      ::new (static_cast<void*>(dst)) Box<F>*{Get(src)};
+    }
+    static void Destroy(Storage* s) { delete Get(s); }
+    static const Ops* Table() {
+      static const Ops ops{&Invoke, &Relocate, &Destroy};
+      return &ops;
+    }
+  };
 
-      std::shared_ptr<ITask> task = waiting_queue_.front();
-      waiting_queue_.pop();
-      waiting_queue_unique_lock.unlock();
+  template <typename F>
+  using FitsInline = std::integral_constant<
+      bool, sizeof(F) <= sizeof(Storage) &&
+                alignof(Storage) % alignof(F) == 0 &&
+                std::is_nothrow_move_constructible<F>::value>;
 
-      auto result = task->Execute();
-      // Process the result of the task execution
-      if (result != nullptr) {
-        if (result == exit_mark_) {
-          ++(*exit_mark_);
-          break;  // Exit the loop if the result is an exit flag
-        }
-        std::lock_guard<std::mutex> results_guard{results_queue_mtx_};
-        results_queue_.push(result);
+  template <typename F>
+  F* Target(std::true_type) {
+    return ops_ == InlineOps<F>::Table() ? InlineOps<F>::Get(&storage_)
+                                         : nullptr;
+  }
+  template <typename F>
+  F* Target(std::false_type) {
+    return ops_ == HeapOps<F>::Table() ? &HeapOps<F>::Get(&storage_)->fn
+                                       : nullptr;
+  }
+
+  template <typename F, typename G>
+  void Construct(G&& fn) {
+    Construct<F>(std::forward<G>(fn), FitsInline<F>{});
+  }
+  template <typename F, typename G>
+  void Construct(G&& fn, std::true_type) {
+    ::new (static_cast<void*>(&storage_)) F(std::forward<G>(fn));
+    ops_ = InlineOps<F>::Table();
+  }
+  template <typename F, typename G>
+  void Construct(G&& fn, std::false_type) {
+    ::new (static_cast<void*>(&storage_))
+        Box<F>*{new Box<F>{std::forward<G>(fn)}};
+    ops_ = HeapOps<F>::Table();
+  }
+  void MoveFrom(TaskFunction& other) noexcept {
+    if (other.ops_ != nullptr) {
+      other.ops_->relocate(&storage_, &other.storage_);
+      ops_ = other.ops_;
+      other.ops_ = nullptr;
+    }
+#if TINY_TP_TRACE
+    traced = other.traced;
+    label = other.label;
+#endif
+  }
+
+  const Ops* ops_{nullptr};
+  Storage storage_;
+
+ public:
+#if TINY_TP_TRACE
+  /// @brief `ReadTsc` when the task was enqueued, 0 if it never was.
+  std::uint64_t traced{0};
+  /// @brief Name of the task in traces, see `TraceLabel`.
+  const char* label{nullptr};
+#endif
+};
+
+/// @brief `TaskFunction` stamped with the time it was enqueued, for the wait
+/// time in the statistics. Only queued by pools whose `StatsPolicy` collects
+/// them, the others queue bare `TaskFunction`s.
+class StampedTask : public TaskFunction {
+ public:
+  StampedTask() = default;
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, StampedTask>::value>::type>
+  StampedTask(F&& fn)  // NOLINT(runtime/explicit)
+      : TaskFunction(std::forward<F>(fn)) {}
+
+  std::chrono::steady_clock::time_point enqueued;
+};
+
+/// @brief Stamps `task` with `now` if it has room for it.
+inline void StampEnqueued(StampedTask& task,
+                          std::chrono::steady_clock::time_point now) {
+  task.enqueued = now;
+}
+inline void StampEnqueued(TaskFunction&,
+                          std::chrono::steady_clock::time_point) {}
+/// @brief When `task` was enqueued, the epoch if it is not stamped.
+inline std::chrono::steady_clock::time_point EnqueuedAt(
+    const StampedTask& task) {
+  return task.enqueued;
+}
+inline std::chrono::steady_clock::time_point EnqueuedAt(const TaskFunction&) {
+  return std::chrono::steady_clock::time_point{};
+}
+
+/// @brief Shared state behind a `Future` and its `Promise`.
+///
+/// Allocated once with the result stored inline. Completing it is lock-free
+/// unless a thread waits in `Wait` or `ThreadPool::WaitFor`, and at most one
+/// continuation can be attached, which runs on the completing thread.
+class FutureStateBase {
+ public:
+  FutureStateBase() = default;
+  FutureStateBase(const FutureStateBase&) = delete;
+  FutureStateBase& operator=(const FutureStateBase&) = delete;
+  virtual ~FutureStateBase() = default;
+
+  void AddRef() { refs_.fetch_add(1, std::memory_order_relaxed); }
+  void Release() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+  bool IsReady() const {
+    return status_.load(std::memory_order_seq_cst) == kReady;
+  }
+  void Wait() {
+    if (IsReady()) {
+      return;
+    }
+    std::unique_lock<std::mutex> unique_lock{mtx_};
+    waiters_.store(true, std::memory_order_seq_cst);
+    cond_.wait(unique_lock, [this]() {
+      return status_.load(std::memory_order_seq_cst) == kReady;
+    });
+  }
+  template <typename Clock, typename Duration>
+  bool WaitUntil(const std::chrono::time_point<Clock, Duration>& deadline) {
+    if (IsReady()) {
+      return true;
+    }
+    std::unique_lock<std::mutex> unique_lock{mtx_};
+    waiters_.store(true, std::memory_order_seq_cst);
+    return cond_.wait_until(unique_lock, deadline, [this]() {
+      return status_.load(std::memory_order_seq_cst) == kReady;
+    });
+  }
+  void SetException(std::exception_ptr exception) {
+    exception_ = std::move(exception);
+    Complete();
+  }
+  /// @brief Runs `continuation` on completion, or right away if completed.
+  void SetContinuation(TaskFunction&& continuation) {
+    continuation_ = std::move(continuation);
+    std::uint8_t expected = kPending;
+    if (!status_.compare_exchange_strong(expected, kHasContinuation,
+                                         std::memory_order_acq_rel)) {
+      TaskFunction run{std::move(continuation_)};
+      run();
+    }
+  }
+  /// @brief Makes completion notify `waker` as well, for a thread that waits
+  /// on it while it runs other tasks, until `RemoveWaker`.
+  void AddWaker(WakerList::Entry* waker) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    wakers_.Add(waker);
+    waiters_.store(true, std::memory_order_seq_cst);
+  }
+  /// @brief Once it returns, completion no longer touches `waker`.
+  void RemoveWaker(WakerList::Entry* waker) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    wakers_.Remove(waker);
+  }
+  /// @brief Rethrows the stored exception, if any.
+  void Check() {
+    if (exception_ != nullptr) {
+      std::rethrow_exception(exception_);
+    }
+  }
+
+ protected:
+  void Complete() {
+    auto previous = status_.exchange(kReady, std::memory_order_seq_cst);
+    if (previous == kHasContinuation) {
+      TaskFunction run{std::move(continuation_)};
+      run();
+    }
+    if (waiters_.load(std::memory_order_seq_cst)) {
+      // Under the lock, a waiter that saw `kReady` still waits in
+      // `RemoveWaker` until its pool is notified.
+      std::lock_guard<std::mutex> guard{mtx_};
+      cond_.notify_all();
+      wakers_.NotifyAll();
+    }
+  }
+
+ private:
+  static constexpr std::uint8_t kPending{0};
+  static constexpr std::uint8_t kHasContinuation{1};
+  static constexpr std::uint8_t kReady{2};
+
+  /// @brief One reference for the `Future` and one for the `Promise`.
+  std::atomic<std::uint32_t> refs_{2};
+  std::atomic<std::uint8_t> status_{kPending};
+  std::atomic<bool> waiters_{false};
+  /// @brief Guarded by `mtx_`.
+  WakerList wakers_;
+  std::exception_ptr exception_;
+  TaskFunction continuation_;
+  std::mutex mtx_;
+  std::condition_variable cond_;
+};
+
+template <typename R>
+class FutureState : public FutureStateBase, public Pooled<FutureState<R>> {
+ public:
+  ~FutureState() override {
+    if (has_value_) {
+      reinterpret_cast<R*>(&value_)->~R();
+    }
+  }
+  template <typename... Args>
+  void SetValue(Args&&... args) {
+    ::new (static_cast<void*>(&value_)) R(std::forward<Args>(args)...);
+    has_value_ = true;
+    Complete();
+  }
+  R TakeValue() {
+    Check();
+    return std::move(*reinterpret_cast<R*>(&value_));
+  }
+
+ private:
+  typename std::aligned_storage<sizeof(R), alignof(R)>::type value_;
+  bool has_value_{false};
+};
+
+template <>
+class FutureState<void> : public FutureStateBase,
+                          public Pooled<FutureState<void>> {
+ public:
+  void SetValue() { Complete(); }
+  void TakeValue() { Check(); }
+};
+
+/// @brief Mutex-protected multi-level FIFO queue with time-based aging.
+///
+/// `TryPop` serves the most urgent non-empty level, unless the head of a less
+/// urgent level has waited for `aging` times the distance between the two
+/// levels, in which case that head is served first, so that a steady stream
+/// of urgent tasks cannot starve the others. `T` is the task type.
+template <typename T>
+class PriorityQueue {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  PriorityQueue(std::size_t capacity, Clock::duration aging)
+      : kCapacity{capacity}, kAging{aging} {}
+
+  /// @return False if the queue is full.
+  bool Push(T&& task, Priority priority) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    if (size_.load(std::memory_order_relaxed) >= kCapacity) {
+      return false;
+    }
+    PushLocked(std::move(task), priority, Stamp(priority));
+    return true;
+  }
+  /// @brief Pushes the tasks of `batch` from index `first` on, in order,
+  /// with a single lock acquisition.
+  /// @return The number of tasks pushed, fewer than offered if the queue
+  /// filled up.
+  std::size_t PushBatch(std::vector<T>& batch, Priority priority,
+                        std::size_t first = 0) {
+    auto enqueued = Stamp(priority);
+    std::lock_guard<std::mutex> guard{mtx_};
+    std::size_t size = size_.load(std::memory_order_relaxed);
+    std::size_t accepted =
+        size < kCapacity ? std::min(batch.size() - first, kCapacity - size) : 0;
+    for (std::size_t i = first; i < first + accepted; ++i) {
+      PushLocked(std::move(batch[i]), priority, enqueued);
+    }
+    return accepted;
+  }
+  bool TryPop(T& task) {
+    if (Empty()) {
+      return false;
+    }
+    std::lock_guard<std::mutex> guard{mtx_};
+    Clock::time_point now{};
+    return PopLocked(task, now);
+  }
+  /// @brief Appends up to `max` tasks to `batch` in dequeue order, with a
+  /// single lock acquisition.
+  /// @return The number of tasks appended.
+  std::size_t TryPopBatch(std::vector<T>& batch, std::size_t max) {
+    if (Empty()) {
+      return 0;
+    }
+    std::lock_guard<std::mutex> guard{mtx_};
+    Clock::time_point now{};
+    std::size_t count = 0;
+    T task;
+    while (count < max && PopLocked(task, now)) {
+      batch.push_back(std::move(task));
+      ++count;
+    }
+    return count;
+  }
+  /// @brief Discards every queued task.
+  void Clear() {
+    std::deque<Entry, PoolAllocator<Entry>> discarded[kNumPriorities];
+    {
+      std::lock_guard<std::mutex> guard{mtx_};
+      for (std::size_t i = 0; i < kNumPriorities; ++i) {
+        discarded[i].swap(levels_[i]);
       }
+      size_.store(0, std::memory_order_relaxed);
+      urgent_.store(0, std::memory_order_relaxed);
+    }
+  }
+  /// @brief Number of queued tasks, without locking.
+  std::size_t Size() const { return size_.load(std::memory_order_relaxed); }
+  bool Empty() const { return Size() == 0; }
+  /// @brief Checks, without locking, for queued `Priority::kHigh` tasks.
+  bool HasUrgent() const {
+    return urgent_.load(std::memory_order_relaxed) != 0;
+  }
+
+ private:
+  static constexpr std::size_t kNumPriorities{3};
+
+  struct Entry {
+    T task;
+    /// @brief Enqueue time, only needed by levels that can age.
+    Clock::time_point enqueued;
+  };
 
-      // Update thread to idle state.
-      threads_idle_unique_lock.lock();
-      threads_idle_[std::this_thread::get_id()] = true;
+  /// @brief Reads the clock only for levels that can age, and only if
+  /// aging is enabled.
+  Clock::time_point Stamp(Priority priority) const {
+    return priority == Priority::kHigh || kAging == Clock::duration::max()
+               ? Clock::time_point{}
+               : Clock::now();
+  }
+  void PushLocked(T&& task, Priority priority,
+                  Clock::time_point enqueued) {
+    auto level = static_cast<std::size_t>(priority);
+    levels_[level].push_back(Entry{std::move(task), enqueued});
+    // Written under the lock, read without it as a hint.
+    size_.fetch_add(1, std::memory_order_relaxed);
+    if (level == 0) {
+      urgent_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  /// @brief Pops the next task, most urgent first unless a less urgent head
+  /// has aged enough. `now` is read lazily and reused across calls.
+  bool PopLocked(T& task, Clock::time_point& now) {
+    std::size_t level = 0;
+    while (level < kNumPriorities && levels_[level].empty()) {
+      ++level;
     }
+    if (level == kNumPriorities) {
+      return false;
+    }
+    // Let the most starved less urgent head overtake, if any has aged enough.
+    std::size_t lowest = kAging == Clock::duration::max() ? level
+                                                          : kNumPriorities - 1;
+    for (std::size_t lower = lowest; lower > level; --lower) {
+      if (levels_[lower].empty()) {
+        continue;
+      }
+      if (now == Clock::time_point{}) {
+        now = Clock::now();
+      }
+      auto distance = static_cast<Clock::rep>(lower - level);
+      if ((now - levels_[lower].front().enqueued) / distance >= kAging) {
+        level = lower;
+        break;
+      }
+    }
+    task = std::move(levels_[level].front().task);
+    levels_[level].pop_front();
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    if (level == 0) {
+      urgent_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return true;
   }
 
-  std::queue<std::shared_ptr<ITask>> waiting_queue_;
-  std::mutex waiting_queue_mtx_;
-  std::condition_variable waiting_queue_cond_;
-  std::queue<std::shared_ptr<void>> results_queue_;
-  std::mutex results_queue_mtx_;
-  std::unordered_map<std::thread::id, bool> threads_idle_;
-  std::mutex threads_idle_mtx_;
+  const std::size_t kCapacity;
+  const Clock::duration kAging;
+  std::mutex mtx_;
+  std::deque<Entry, PoolAllocator<Entry>> levels_[kNumPriorities];
+  std::atomic<std::size_t> size_{0};
+  std::atomic<std::size_t> urgent_{0};
+};
+
+/// @brief Bounded lock-free multi-producer multi-consumer queue of tasks with
+/// the priority levels and aging of `PriorityQueue`.
+///
+/// Each level is a power-of-two ring of sequence-numbered slots (Vyukov),
+/// allocated once. A shared counter enforces the capacity across levels, so a
+/// producer that got room never fails to obtain a slot.
+template <typename T>
+class RingQueue {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  RingQueue(std::size_t capacity, Clock::duration aging)
+      : kCapacity{capacity}, kAging{aging}, kMask{RingSize(capacity) - 1} {
+    for (auto& level : levels_) {
+      level.slots.reset(new Slot[kMask + 1]);
+      for (std::size_t i = 0; i <= kMask; ++i) {
+        level.slots[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// @return False if the queue is full.
+  bool Push(T&& task, Priority priority) {
+    if (Reserve(1) == 0) {
+      return false;
+    }
+    PushReserved(std::move(task), priority, Stamp(priority));
+    return true;
+  }
+  /// @brief Pushes the tasks of `batch` from index `first` on, in order.
+  /// @return The number of tasks pushed, fewer than offered if the queue
+  /// filled up.
+  std::size_t PushBatch(std::vector<T>& batch, Priority priority,
+                        std::size_t first = 0) {
+    std::size_t accepted = Reserve(batch.size() - first);
+    auto enqueued = Stamp(priority);
+    for (std::size_t i = first; i < first + accepted; ++i) {
+      PushReserved(std::move(batch[i]), priority, enqueued);
+    }
+    return accepted;
+  }
+  bool TryPop(T& task) {
+    if (Empty()) {
+      return false;
+    }
+    std::size_t level = 0;
+    Clock::rep enqueued;
+    while (level < kNumPriorities && !PeekHead(level, enqueued)) {
+      ++level;
+    }
+    if (level == kNumPriorities) {
+      return false;
+    }
+    // Let the most starved less urgent head overtake, if any has aged enough.
+    Clock::time_point now{};
+    std::size_t lowest = kAging == Clock::duration::max() ? level
+                                                          : kNumPriorities - 1;
+    for (std::size_t lower = lowest; lower > level; --lower) {
+      if (!PeekHead(lower, enqueued)) {
+        continue;
+      }
+      if (now == Clock::time_point{}) {
+        now = Clock::now();
+      }
+      auto distance = static_cast<Clock::rep>(lower - level);
+      auto waited = now - Clock::time_point{Clock::duration{enqueued}};
+      if (waited / distance >= kAging) {
+        level = lower;
+        break;
+      }
+    }
+    if (PopFrom(level, task)) {
+      return true;
+    }
+    // Lost the head to another consumer.
+    for (std::size_t other = 0; other < kNumPriorities; ++other) {
+      if (other != level && PopFrom(other, task)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  /// @brief Appends up to `max` tasks to `batch` in dequeue order.
+  /// @return The number of tasks appended.
+  std::size_t TryPopBatch(std::vector<T>& batch, std::size_t max) {
+    std::size_t count = 0;
+    T task;
+    while (count < max && TryPop(task)) {
+      batch.push_back(std::move(task));
+      ++count;
+    }
+    return count;
+  }
+  /// @brief Discards every queued task, must not race with producers.
+  void Clear() {
+    T task;
+    while (TryPop(task)) {
+      task.Reset();
+    }
+  }
+  /// @brief Number of queued tasks, including ones being pushed.
+  std::size_t Size() const {
+    return size_.value.load(std::memory_order_relaxed);
+  }
+  bool Empty() const { return Size() == 0; }
+  /// @brief Checks for queued `Priority::kHigh` tasks.
+  bool HasUrgent() const {
+    const Level& level = levels_[0];
+    return level.tail.value.load(std::memory_order_relaxed) !=
+           level.head.value.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr std::size_t kNumPriorities{3};
+
+  struct Slot {
+    /// @brief Position the slot is free for, plus one once it is filled.
+    std::atomic<std::size_t> sequence{0};
+    /// @brief Enqueue time, read by other levels deciding on aging.
+    std::atomic<Clock::rep> enqueued{0};
+    T task;
+  };
+  struct Level {
+    CacheLinePadded<std::atomic<std::size_t>> head{{}, {0}, {}};
+    CacheLinePadded<std::atomic<std::size_t>> tail{{}, {0}, {}};
+    std::unique_ptr<Slot[]> slots;
+  };
+
+  static std::size_t RingSize(std::size_t capacity) {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+  /// @brief Reads the clock only for levels that can age, and only if
+  /// aging is enabled.
+  Clock::rep Stamp(Priority priority) const {
+    return priority == Priority::kHigh || kAging == Clock::duration::max()
+               ? 0
+               : Clock::now().time_since_epoch().count();
+  }
+  /// @brief Claims room for up to `count` tasks.
+  /// @return The number of tasks there is room for.
+  std::size_t Reserve(std::size_t count) {
+    std::size_t size = size_.value.load(std::memory_order_relaxed);
+    std::size_t reserved;
+    do {
+      if (size >= kCapacity) {
+        return 0;
+      }
+      reserved = std::min(count, kCapacity - size);
+    } while (!size_.value.compare_exchange_weak(size, size + reserved,
+                                          std::memory_order_relaxed));
+    return reserved;
+  }
+  void PushReserved(T&& task, Priority priority,
+                    Clock::rep enqueued) {
+    Level& level = levels_[static_cast<std::size_t>(priority)];
+    std::size_t pos = level.tail.value.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = level.slots[pos & kMask];
+    // The room was reserved, at worst a consumer is still moving a task out.
+    while (slot.sequence.load(std::memory_order_acquire) != pos) {
+      CpuRelax();
+    }
+    slot.task = std::move(task);
+    slot.enqueued.store(enqueued, std::memory_order_relaxed);
+    slot.sequence.store(pos + 1, std::memory_order_release);
+  }
+  /// @return False if the level has no published head task.
+  bool PeekHead(std::size_t index, Clock::rep& enqueued) const {
+    const Level& level = levels_[index];
+    std::size_t pos = level.head.value.load(std::memory_order_relaxed);
+    const Slot& slot = level.slots[pos & kMask];
+    if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+      return false;
+    }
+    enqueued = slot.enqueued.load(std::memory_order_relaxed);
+    return true;
+  }
+  bool PopFrom(std::size_t index, T& task) {
+    Level& level = levels_[index];
+    std::size_t pos = level.head.value.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+      slot = &level.slots[pos & kMask];
+      auto diff = static_cast<std::ptrdiff_t>(
+          slot->sequence.load(std::memory_order_acquire) - (pos + 1));
+      if (diff == 0) {
+        if (level.head.value.compare_exchange_weak(
+                pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = level.head.value.load(std::memory_order_relaxed);
+      }
+    }
+    task = std::move(slot->task);
+    slot->sequence.store(pos + kMask + 1, std::memory_order_release);
+    size_.value.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  const std::size_t kCapacity;
+  const Clock::duration kAging;
+  const std::size_t kMask;
+  Level levels_[kNumPriorities];
+  CacheLinePadded<std::atomic<std::size_t>> size_{{}, {0}, {}};
+};
+
+/// @brief The shared queue of a `ThreadPool`, backed by the selected
+/// `QueueBackend`.
+template <typename T>
+class SharedQueue {
+ public:
+  SharedQueue(QueueBackend backend, std::size_t capacity,
+              std::chrono::steady_clock::duration aging)
+      : locked_{capacity, aging},
+        ring_{backend == QueueBackend::kLockFree
+                  ? new RingQueue<T>{capacity, aging}
+                  : nullptr} {}
+
+  bool Push(T&& task, Priority priority) {
+    return ring_ ? ring_->Push(std::move(task), priority)
+                 : locked_.Push(std::move(task), priority);
+  }
+  std::size_t PushBatch(std::vector<T>& batch, Priority priority,
+                        std::size_t first = 0) {
+    return ring_ ? ring_->PushBatch(batch, priority, first)
+                 : locked_.PushBatch(batch, priority, first);
+  }
+  bool TryPop(T& task) {
+    return ring_ ? ring_->TryPop(task) : locked_.TryPop(task);
+  }
+  std::size_t TryPopBatch(std::vector<T>& batch, std::size_t max) {
+    return ring_ ? ring_->TryPopBatch(batch, max)
+                 : locked_.TryPopBatch(batch, max);
+  }
+  void Clear() { ring_ ? ring_->Clear() : locked_.Clear(); }
+  std::size_t Size() const { return ring_ ? ring_->Size() : locked_.Size(); }
+  bool Empty() const { return Size() == 0; }
+  bool HasUrgent() const {
+    return ring_ ? ring_->HasUrgent() : locked_.HasUrgent();
+  }
+
+ private:
+  PriorityQueue<T> locked_;
+  const std::unique_ptr<RingQueue<T>> ring_;
+};
+
+/// @brief Returns the number of trailing zero bits of a non-zero `value`.
+inline unsigned CountTrailingZeros(std::uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_ctzll(value));
+#else
+  unsigned count = 0;
+  while ((value & 1) == 0) {
+    value >>= 1;
+    ++count;
+  }
+  return count;
+#endif
+}
+
+/// @brief Returns the index of the highest set bit of a non-zero `value`.
+inline unsigned FloorLog2(std::uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#else
+  unsigned log = 0;
+  while (value >>= 1) {
+    ++log;
+  }
+  return log;
+#endif
+}
+
+/// @brief Hierarchical timing wheel driven by one dedicated thread.
+///
+/// Four levels of 64 slots each cover 64^4 ticks, timers further away wait in
+/// the last level and are re-inserted when they get closer. Every slot is an
+/// intrusive list, so inserting and cancelling a timer is O(1), and the
+/// thread only wakes up for occupied slots or to cascade a level down.
+/// Expired timers are handed to the dispatch function of their node, which
+/// normally enqueues them into a `ThreadPool`.
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /// @brief Hands a fired timer over for execution.
+  /// @return False if it could not be enqueued, it is then retried a tick
+  /// later.
+  using DispatchFunction = bool (*)(void* target, TaskFunction&& task);
+
+  class Node : public Pooled<Node> {
+   public:
+    void AddRef() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void Release() {
+      if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+      }
+    }
+
+   private:
+    friend class TimerWheel;
+
+    enum State : std::uint8_t { kScheduled, kRunning, kCancelled, kDone };
+
+    Node(TaskFunction&& fn, Clock::duration period, DispatchFunction dispatch,
+         void* target)
+        : fn_{std::move(fn)}, period_{period}, dispatch_{dispatch},
+          target_{target} {}
+
+    Node* prev_{nullptr};
+    Node* next_{nullptr};
+    /// @brief Index of the slot list, `kUnlinked` while not in the wheel.
+    std::size_t list_{kUnlinked};
+    /// @brief When the timer is due next, and the matching tick.
+    Clock::time_point due_;
+    std::uint64_t expiry_{0};
+    TaskFunction fn_;
+    const Clock::duration period_;
+    const DispatchFunction dispatch_;
+    void* const target_;
+    std::atomic<std::uint8_t> state_{kScheduled};
+    /// @brief One reference for the handle, one while in the wheel or queued.
+    std::atomic<std::uint32_t> refs_{2};
+  };
+
+  explicit TimerWheel(Clock::duration tick)
+      : kTick{tick > Clock::duration::zero() ? tick : Clock::duration{1}},
+        start_{Clock::now()}, thread_{&TimerWheel::Run, this} {}
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+  ~TimerWheel() { Stop(); }
+
+  /// @brief Schedules `fn` at `when`, and every `period` after that if it is
+  /// positive.
+  /// @return The timer, with one reference owned by the caller.
+  Node* Schedule(Clock::time_point when, Clock::duration period,
+                 TaskFunction&& fn, DispatchFunction dispatch, void* target) {
+    Node* node = new Node{std::move(fn), period, dispatch, target};
+    std::lock_guard<std::mutex> guard{mtx_};
+    if (stopped_) {
+      node->state_.store(Node::kCancelled, std::memory_order_relaxed);
+      node->Release();
+      return node;
+    }
+    SkipAheadIfEmpty();
+    node->due_ = when;
+    node->expiry_ = ToTick(when);
+    Link(node);
+    return node;
+  }
+  /// @brief Stops the timer from firing again.
+  /// @return True if a pending expiry was cancelled, false if the timer
+  /// already fired (one-shot) or was cancelled before.
+  bool Cancel(Node* node) {
+    auto state = node->state_.load(std::memory_order_acquire);
+    while (state == Node::kScheduled ||
+           (state == Node::kRunning &&
+            node->period_ > Clock::duration::zero())) {
+      if (node->state_.compare_exchange_weak(state, Node::kCancelled,
+                                             std::memory_order_acq_rel)) {
+        std::lock_guard<std::mutex> guard{mtx_};
+        if (node->list_ != kUnlinked) {
+          Unlink(node);
+          node->Release();
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+  /// @brief Cancels every timer and joins the timer thread.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> guard{mtx_};
+      if (stopped_) {
+        return;
+      }
+      stopped_ = true;
+      for (std::size_t list = 0; list < kLevels * kSlots; ++list) {
+        while (slots_[list] != nullptr) {
+          Node* node = slots_[list];
+          Unlink(node);
+          node->state_.store(Node::kCancelled, std::memory_order_release);
+          node->Release();
+        }
+      }
+    }
+    cond_.notify_all();
+    thread_.join();
+  }
+  /// @brief Number of timers waiting in the wheel.
+  std::size_t Size() {
+    std::lock_guard<std::mutex> guard{mtx_};
+    return count_;
+  }
+
+ private:
+  static constexpr std::size_t kLevelBits{6};
+  static constexpr std::size_t kSlots{std::size_t{1} << kLevelBits};
+  static constexpr std::size_t kLevels{4};
+  static constexpr std::size_t kUnlinked{kLevels * kSlots};
+  static constexpr std::uint64_t kSlotMask{kSlots - 1};
+
+  /// @brief Runs a fired timer on a pool thread, then re-arms it if it is
+  /// periodic.
+  class Fire {
+   public:
+    Fire(TimerWheel* wheel, Node* node) : wheel_{wheel}, node_{node} {}
+    Fire(Fire&& other) noexcept : wheel_{other.wheel_}, node_{other.node_} {
+      other.node_ = nullptr;
+    }
+    Fire(const Fire&) = delete;
+    Fire& operator=(const Fire&) = delete;
+    ~Fire() {
+      if (node_ != nullptr) {
+        node_->Release();
+      }
+    }
+    void operator()() {
+      std::uint8_t expected = Node::kScheduled;
+      if (!node_->state_.compare_exchange_strong(expected, Node::kRunning,
+                                                 std::memory_order_acq_rel)) {
+        return;  // Cancelled while queued.
+      }
+      node_->fn_();
+      if (node_->period_ <= Clock::duration::zero()) {
+        node_->state_.store(Node::kDone, std::memory_order_release);
+        return;
+      }
+      expected = Node::kRunning;
+      if (node_->state_.compare_exchange_strong(expected, Node::kScheduled,
+                                                std::memory_order_acq_rel)) {
+        wheel_->Rearm(node_);
+        node_ = nullptr;  // The reference now belongs to the wheel.
+      }
+    }
+
+   private:
+    TimerWheel* wheel_;
+    Node* node_;
+  };
+
+  /// @brief Rounds up, so that timers never fire early.
+  std::uint64_t ToTick(Clock::time_point when) const {
+    if (when <= start_) {
+      return 0;
+    }
+    auto ticks = (when - start_ + kTick - Clock::duration{1}) / kTick;
+    return static_cast<std::uint64_t>(ticks);
+  }
+  std::uint64_t ElapsedTicks() const {
+    return static_cast<std::uint64_t>((Clock::now() - start_) / kTick);
+  }
+  /// @brief Catches the current tick up while the timer thread, having no
+  /// timers, does not; must hold `mtx_`.
+  void SkipAheadIfEmpty() {
+    if (count_ == 0) {
+      now_ = std::max(now_, ElapsedTicks());
+    }
+  }
+
+  void Rearm(Node* node) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    if (stopped_) {
+      node->state_.store(Node::kCancelled, std::memory_order_release);
+      node->Release();
+      return;
+    }
+    SkipAheadIfEmpty();
+    // Drift-free, a late run is followed by an immediate one.
+    node->due_ += node->period_;
+    node->expiry_ = ToTick(node->due_);
+    Link(node);
+  }
+  /// @brief Inserts `node` into the slot matching its expiry; must hold
+  /// `mtx_`.
+  void Link(Node* node) {
+    if (node->expiry_ <= now_) {
+      node->expiry_ = now_ + 1;
+    }
+    std::uint64_t delta = node->expiry_ - now_;
+    std::size_t level = 0;
+    while (level + 1 < kLevels &&
+           delta >= (std::uint64_t{1} << ((level + 1) * kLevelBits))) {
+      ++level;
+    }
+    std::uint64_t expiry = node->expiry_;
+    if (level + 1 == kLevels &&
+        delta >= (std::uint64_t{1} << (kLevels * kLevelBits))) {
+      // Beyond the wheel, park at its far end and re-insert from there.
+      expiry = now_ + (std::uint64_t{1} << (kLevels * kLevelBits)) - 1;
+    }
+    std::size_t slot = (expiry >> (level * kLevelBits)) & kSlotMask;
+    std::size_t list = level * kSlots + slot;
+    node->list_ = list;
+    node->prev_ = nullptr;
+    node->next_ = slots_[list];
+    if (node->next_ != nullptr) {
+      node->next_->prev_ = node;
+    }
+    slots_[list] = node;
+    occupied_[level] |= std::uint64_t{1} << slot;
+    ++count_;
+    if (node->expiry_ < wake_) {
+      cond_.notify_one();  // The timer thread sleeps past this expiry.
+    }
+  }
+  void Unlink(Node* node) {
+    std::size_t list = node->list_;
+    if (node->prev_ != nullptr) {
+      node->prev_->next_ = node->next_;
+    } else {
+      slots_[list] = node->next_;
+    }
+    if (node->next_ != nullptr) {
+      node->next_->prev_ = node->prev_;
+    }
+    if (slots_[list] == nullptr) {
+      occupied_[list / kSlots] &= ~(std::uint64_t{1} << (list % kSlots));
+    }
+    node->list_ = kUnlinked;
+    node->prev_ = node->next_ = nullptr;
+    --count_;
+  }
+  /// @brief Moves the whole list out of a slot.
+  Node* TakeSlot(std::size_t level, std::size_t slot) {
+    std::size_t list = level * kSlots + slot;
+    Node* head = slots_[list];
+    for (Node* node = head; node != nullptr; node = node->next_) {
+      node->list_ = kUnlinked;
+      --count_;
+    }
+    slots_[list] = nullptr;
+    occupied_[level] &= ~(std::uint64_t{1} << slot);
+    return head;
+  }
+  /// @brief Advances the wheel by one tick, collecting expired timers.
+  void Advance(std::vector<Node*>& expired) {
+    ++now_;
+    // Cascade timers of each level whose lower levels have wrapped around.
+    for (std::size_t level = 1; level < kLevels; ++level) {
+      if ((now_ & ((std::uint64_t{1} << (level * kLevelBits)) - 1)) != 0) {
+        break;
+      }
+      Node* node = TakeSlot(level, (now_ >> (level * kLevelBits)) & kSlotMask);
+      while (node != nullptr) {
+        Node* next = node->next_;
+        if (node->expiry_ <= now_) {
+          // Due at this very tick, `Link` would delay it by one.
+          node->prev_ = node->next_ = nullptr;
+          expired.push_back(node);
+        } else {
+          Link(node);
+        }
+        node = next;
+      }
+    }
+    Node* node = TakeSlot(0, now_ & kSlotMask);
+    while (node != nullptr) {
+      Node* next = node->next_;
+      node->prev_ = node->next_ = nullptr;
+      expired.push_back(node);
+      node = next;
+    }
+  }
+  /// @brief The next tick at which the wheel has work to do.
+  std::uint64_t NextWakeTick() const {
+    std::uint64_t wake = std::numeric_limits<std::uint64_t>::max();
+    for (std::size_t level = 1; level < kLevels; ++level) {
+      if (occupied_[level] != 0) {
+        // The next cascade of level 1.
+        wake = (now_ | kSlotMask) + 1;
+        break;
+      }
+    }
+    if (occupied_[0] != 0) {
+      unsigned from = static_cast<unsigned>((now_ + 1) & kSlotMask);
+      std::uint64_t rotated = (occupied_[0] >> from) |
+                              (from != 0 ? occupied_[0] << (kSlots - from) : 0);
+      wake = std::min(wake, now_ + 1 + CountTrailingZeros(rotated));
+    }
+    return wake;
+  }
+
+  void Run() {
+    std::vector<Node*> expired;
+    std::unique_lock<std::mutex> unique_lock{mtx_};
+    while (!stopped_) {
+      std::uint64_t elapsed = ElapsedTicks();
+      if (count_ == 0 && elapsed > now_) {
+        now_ = elapsed;  // Nothing to cascade or fire, skip ahead.
+      }
+      while (now_ < elapsed) {
+        Advance(expired);
+      }
+      if (!expired.empty()) {
+        unique_lock.unlock();
+        Dispatch(expired);
+        unique_lock.lock();
+        continue;
+      }
+      wake_ = NextWakeTick();
+      if (wake_ == std::numeric_limits<std::uint64_t>::max()) {
+        cond_.wait(unique_lock);
+      } else {
+        auto ticks = static_cast<Clock::rep>(wake_);
+        cond_.wait_until(unique_lock, start_ + kTick * ticks);
+      }
+      wake_ = 0;  // Awake, inserts need not notify.
+    }
+  }
+  void Dispatch(std::vector<Node*>& expired) {
+    for (Node* node : expired) {
+      if (node->state_.load(std::memory_order_acquire) != Node::kScheduled) {
+        node->Release();
+        continue;
+      }
+      node->AddRef();  // For the task.
+      if (node->dispatch_(node->target_, TaskFunction{Fire{this, node}})) {
+        node->Release();  // Out of the wheel.
+        continue;
+      }
+      // Rejected, retry at the next tick.
+      std::lock_guard<std::mutex> guard{mtx_};
+      if (!stopped_ &&
+          node->state_.load(std::memory_order_acquire) == Node::kScheduled) {
+        node->expiry_ = now_ + 1;
+        Link(node);
+      } else {
+        node->Release();
+      }
+    }
+    expired.clear();
+  }
+
+  const Clock::duration kTick;
+  const Clock::time_point start_;
+  std::mutex mtx_;
+  std::condition_variable cond_;
+  Node* slots_[kLevels * kSlots] = {};
+  std::uint64_t occupied_[kLevels] = {};
+  std::size_t count_{0};
+  /// @brief The current tick, every timer up to it has been expired.
+  std::uint64_t now_{0};
+  /// @brief The tick the sleeping timer thread wakes up at, 0 while awake.
+  std::uint64_t wake_{0};
+  bool stopped_{false};
+  std::thread thread_;
+};
+
+/// @brief Chase-Lev work-stealing deque of pointers.
+///
+/// Only the owner thread may call `Push` and `Pop` (LIFO end), any thread may
+/// call `Steal` (FIFO end). Buffers grow on demand and retired buffers are kept
+/// until destruction, since a thief may still be reading from them.
+template <typename T>
+class WorkStealingDeque {
+ public:
+  explicit WorkStealingDeque(std::int64_t capacity = 256)
+      : buffer_{new Buffer{capacity}} {
+    retired_.emplace_back(buffer_.load(std::memory_order_relaxed));
+  }
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+  ~WorkStealingDeque() {
+    T* item = nullptr;
+    while ((item = Pop()) != nullptr) {
+      delete item;
+    }
+  }
+
+  void Push(T* item) {
+    std::int64_t b = bottom_.load(std::memory_order_relaxed);
+    std::int64_t t = top_.load(std::memory_order_acquire);
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    if (b - t > buffer->capacity - 1) {
+      buffer = Grow(buffer, t, b);
+    }
+    buffer->Put(b, item);
+    // A release store rather than a fence, which race detectors understand.
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+  T* Pop() {
+    std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      // Empty, restore the bottom.
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T* item = buffer->Get(b);
+    if (t == b) {
+      // Last item, race against thieves for it.
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+  T* Steal() {
+    std::int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    T* item = buffer_.load(std::memory_order_acquire)->Get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;  // Lost the race to another thief or the owner.
+    }
+    return item;
+  }
+  /// @brief Approximate number of items, exact only for the owner thread.
+  std::size_t Size() const {
+    std::int64_t b = bottom_.load(std::memory_order_relaxed);
+    std::int64_t t = top_.load(std::memory_order_relaxed);
+    return b > t ? static_cast<std::size_t>(b - t) : 0;
+  }
+  bool Empty() const { return Size() == 0; }
+
+ private:
+  struct Buffer {
+    explicit Buffer(std::int64_t cap)
+        : capacity{cap}, slots{new std::atomic<T*>[static_cast<size_t>(cap)]} {}
+    void Put(std::int64_t i, T* item) {
+      slots[i & (capacity - 1)].store(item, std::memory_order_relaxed);
+    }
+    T* Get(std::int64_t i) const {
+      return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+    }
+    const std::int64_t capacity;
+    std::unique_ptr<std::atomic<T*>[]> slots;
+  };
+
+  Buffer* Grow(Buffer* old, std::int64_t t, std::int64_t b) {
+    Buffer* buffer = new Buffer{old->capacity * 2};
+    retired_.emplace_back(buffer);
+    for (std::int64_t i = t; i < b; ++i) {
+      buffer->Put(i, old->Get(i));
+    }
+    buffer_.store(buffer, std::memory_order_release);
+    return buffer;
+  }
+
+  std::atomic<std::int64_t> top_{0};
+  std::atomic<std::int64_t> bottom_{0};
+  std::atomic<Buffer*> buffer_;
+  /// @brief Every buffer ever used, owned here and released on destruction.
+  std::vector<std::unique_ptr<Buffer>> retired_;
+};
+
+}  // namespace detail
+
+/// @brief Exception delivered through the `Future` of a task that was
+/// skipped because its `CancellationToken` was cancelled or expired.
+class TaskCancelled : public std::runtime_error {
+ public:
+  TaskCancelled() : std::runtime_error{"tiny_tp: task cancelled"} {}
+};
+
+/// @brief Shared flag withdrawing queued tasks, with an optional deadline.
+///
+/// Tasks added with a token are checked when dequeued. If the token was
+/// cancelled or its deadline has passed, the task is discarded without
+/// running, and its `Future` throws `TaskCancelled`. A running task is not
+/// interrupted, but may poll `IsCancelled` itself. Copies share the state,
+/// and one token may cover any number of tasks.
+class CancellationToken {
+ public:
+  CancellationToken() : CancellationToken{Clock::time_point::max()} {}
+  /// @brief Creates a token that expires at `deadline`.
+  explicit CancellationToken(std::chrono::steady_clock::time_point deadline)
+      : state_{new State{deadline}} {}
+  CancellationToken(const CancellationToken& other) noexcept
+      : state_{other.state_} {
+    state_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  CancellationToken& operator=(const CancellationToken& other) noexcept {
+    CancellationToken copy{other};
+    std::swap(state_, copy.state_);
+    return *this;
+  }
+  ~CancellationToken() {
+    if (state_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete state_;
+    }
+  }
+
+  /// @brief Withdraws every task of this token that has not started yet.
+  void Cancel() { state_->cancelled.store(true, std::memory_order_relaxed); }
+  /// @brief Checks whether the token was cancelled or has expired.
+  bool IsCancelled() const {
+    return state_->cancelled.load(std::memory_order_relaxed) ||
+           (state_->deadline != Clock::time_point::max() &&
+            Clock::now() >= state_->deadline);
+  }
+  std::chrono::steady_clock::time_point deadline() const {
+    return state_->deadline;
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct State : detail::Pooled<State> {
+    explicit State(Clock::time_point when) : deadline{when} {}
+    const Clock::time_point deadline;
+    std::atomic<bool> cancelled{false};
+    std::atomic<std::uint32_t> refs{1};
+  };
+
+  State* state_;
+};
+
+/// @brief The result of an asynchronous task, delivered exactly once.
+///
+/// A default-constructed `Future`, or one returned for a rejected submission,
+/// is not `valid()`, and waiting on it or getting its result throws a
+/// `std::future_error` with `std::future_errc::no_state`, like `std::future`.
+/// `Get` consumes the result and invalidates the `Future`.
+/// @tparam R The result type, stored by value.
+template <typename R>
+class Future {
+ public:
+  Future() = default;
+  Future(Future&& other) noexcept : state_{other.state_} {
+    other.state_ = nullptr;
+  }
+  Future& operator=(Future&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      state_ = other.state_;
+      other.state_ = nullptr;
+    }
+    return *this;
+  }
+  Future(const Future&) = delete;
+  Future& operator=(const Future&) = delete;
+  ~Future() { Reset(); }
+
+  bool valid() const { return state_ != nullptr; }
+  /// @brief Checks whether the result is available (non-blocking).
+  bool IsReady() const { return CheckedState()->IsReady(); }
+  /// @brief Blocks until the result is available.
+  void Wait() const { CheckedState()->Wait(); }
+  /// @brief Blocks until the result is available or `timeout` passes.
+  /// @return True if the result is available.
+  template <typename Rep, typename Period>
+  bool WaitFor(const std::chrono::duration<Rep, Period>& timeout) const {
+    return CheckedState()->WaitUntil(std::chrono::steady_clock::now() +
+                                     timeout);
+  }
+  template <typename Clock, typename Duration>
+  bool WaitUntil(const std::chrono::time_point<Clock, Duration>& deadline) const {
+    return CheckedState()->WaitUntil(deadline);
+  }
+  /// @brief Blocks until the result is available and takes it, rethrowing
+  /// the exception of the task if it threw one.
+  R Get() {
+    CheckedState()->Wait();
+    Future released{std::move(*this)};
+    return released.state_->TakeValue();
+  }
+  /// @brief Calls `fn(future)` with this `Future` once it is ready, on the
+  /// thread that completes it, or right away if it is already ready. Keep
+  /// `fn` short, or `Submit` the actual work from it. Invalidates this
+  /// `Future`.
+  template <typename F>
+  void Then(F&& fn) {
+    detail::FutureState<R>* state = CheckedState();
+    state->SetContinuation(detail::TaskFunction{ContinuationCall<
+        typename std::decay<F>::type>{std::forward<F>(fn), std::move(*this)}});
+  }
+
+ private:
+  template <typename T>
+  friend class Promise;
+  template <typename, typename, typename, typename>
+  friend class BasicThreadPool;
+
+  template <typename F>
+  class ContinuationCall {
+   public:
+    ContinuationCall(F&& fn, Future&& future)
+        : fn_{std::move(fn)}, future_{std::move(future)} {}
+    ContinuationCall(const F& fn, Future&& future)
+        : fn_{fn}, future_{std::move(future)} {}
+    void operator()() { fn_(future_); }
+
+   private:
+    F fn_;
+    Future future_;
+  };
+
+  explicit Future(detail::FutureState<R>* state) : state_{state} {}
+  /// @brief The shared state, throws if there is none.
+  detail::FutureState<R>* CheckedState() const {
+    if (state_ == nullptr) {
+      throw std::future_error{std::future_errc::no_state};
+    }
+    return state_;
+  }
+  void Reset() {
+    if (state_ != nullptr) {
+      state_->Release();
+      state_ = nullptr;
+    }
+  }
+
+  detail::FutureState<R>* state_{nullptr};
+};
+
+/// @brief The producing side of a `Future`.
+///
+/// Destroying a `Promise` without setting it stores a `std::future_error`
+/// with `std::future_errc::broken_promise` in its `Future`. Like
+/// `std::promise`, misuse throws a `std::future_error`: setting it twice
+/// with `promise_already_satisfied`, a second `GetFuture` with
+/// `future_already_retrieved`, and any call on a moved-from `Promise` with
+/// `no_state`.
+/// @tparam R The result type.
+template <typename R>
+class Promise {
+ public:
+  Promise() : state_{new detail::FutureState<R>} {}
+  Promise(Promise&& other) noexcept
+      : state_{other.state_},
+        retrieved_{other.retrieved_},
+        satisfied_{other.satisfied_} {
+    other.state_ = nullptr;
+  }
+  Promise& operator=(Promise&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      state_ = other.state_;
+      retrieved_ = other.retrieved_;
+      satisfied_ = other.satisfied_;
+      other.state_ = nullptr;
+    }
+    return *this;
+  }
+  Promise(const Promise&) = delete;
+  Promise& operator=(const Promise&) = delete;
+  ~Promise() { Reset(); }
+
+  /// @brief Returns the `Future` of this `Promise`, callable only once.
+  Future<R> GetFuture() {
+    detail::FutureState<R>* state = CheckedState();
+    if (retrieved_) {
+      throw std::future_error{std::future_errc::future_already_retrieved};
+    }
+    retrieved_ = true;
+    return Future<R>{state};
+  }
+  template <typename... Args>
+  void SetValue(Args&&... args) {
+    UnsatisfiedState()->SetValue(std::forward<Args>(args)...);
+    satisfied_ = true;
+  }
+  void SetException(std::exception_ptr exception) {
+    UnsatisfiedState()->SetException(std::move(exception));
+    satisfied_ = true;
+  }
+
+ private:
+  detail::FutureState<R>* CheckedState() const {
+    if (state_ == nullptr) {
+      throw std::future_error{std::future_errc::no_state};
+    }
+    return state_;
+  }
+  detail::FutureState<R>* UnsatisfiedState() const {
+    detail::FutureState<R>* state = CheckedState();
+    if (satisfied_) {
+      throw std::future_error{std::future_errc::promise_already_satisfied};
+    }
+    return state;
+  }
+  void Reset() {
+    if (state_ == nullptr) {
+      return;
+    }
+    if (!satisfied_) {
+      state_->SetException(std::make_exception_ptr(
+          std::future_error{std::future_errc::broken_promise}));
+    }
+    if (!retrieved_) {
+      state_->Release();  // Nobody will ever hold the future reference.
+    }
+    state_->Release();
+    state_ = nullptr;
+  }
+
+  detail::FutureState<R>* state_;
+  bool retrieved_{false};
+  bool satisfied_{false};
+};
+
+namespace detail {
+
+/// @brief Runs a callable and stores its result, or its exception, in a
+/// `Promise`.
+template <typename R, typename F>
+class PromiseCall {
+ public:
+  PromiseCall(F&& fn, Promise<R>&& promise)
+      : fn_{std::move(fn)}, promise_{std::move(promise)} {}
+  void operator()() {
+    try {
+      Run(std::is_void<R>{});
+    } catch (...) {
+      promise_.SetException(std::current_exception());
+    }
+  }
+  /// @brief Completes the `Future` with `TaskCancelled` instead of running.
+  void Cancel() {
+    promise_.SetException(std::make_exception_ptr(TaskCancelled{}));
+  }
+
+ private:
+  void Run(std::true_type) {
+    fn_();
+    promise_.SetValue();
+  }
+  void Run(std::false_type) { promise_.SetValue(fn_()); }
+
+  F fn_;
+  Promise<R> promise_;
+};
+
+/// @brief The decayed result type of calling `F` with `Args`.
+template <typename F, typename... Args>
+using ResultOf = typename std::decay<decltype(std::declval<
+    typename std::decay<F>::type&>()(
+    std::declval<typename std::decay<Args>::type&>()...))>::type;
+
+}  // namespace detail
+
+#if TINY_TP_COROUTINES
+template <typename T>
+class Task;
+
+namespace detail {
+
+/// @brief The part of the promise of a `Task` that does not depend on `T`.
+class TaskPromiseBase : public Pooled<TaskPromiseBase> {
+ public:
+  /// @brief Resumes the awaiting coroutine by symmetric transfer, so chains
+  /// of tasks completing each other on other threads do not grow the stack.
+  class FinalAwaiter {
+   public:
+    bool await_ready() const noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<P> coroutine) noexcept {
+      TaskPromiseBase& promise = coroutine.promise();
+      if (promise.Arrive()) {
+        return promise.continuation_;
+      }
+      return std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+  };
+
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  FinalAwaiter final_suspend() const noexcept { return {}; }
+  void unhandled_exception() { exception_ = std::current_exception(); }
+  /// @brief Starts `coroutine` on behalf of `continuation`.
+  /// @param parent The promise of `continuation` if it is a `Task`.
+  /// @param root See `root`.
+  /// @return False if it already completed, `continuation` then goes on
+  /// without being suspended.
+  bool Start(std::coroutine_handle<> coroutine,
+             std::coroutine_handle<> continuation, TaskPromiseBase* parent,
+             std::coroutine_handle<> root) {
+    continuation_ = continuation;
+    parent_ = parent;
+    root_ = root;
+    coroutine.resume();
+    if (!Arrive()) {
+      return true;
+    }
+    if (abandoned_) {
+      // Discarded while this thread was starting it, the chain is freed
+      // from here and nothing may be touched afterwards.
+      Abandon(parent_, root_);
+      return true;
+    }
+    return false;
+  }
+  /// @brief The coroutine at the top of the chain awaiting this one, whose
+  /// destruction frees the whole chain, null if it is not known.
+  std::coroutine_handle<> root() const { return root_; }
+  /// @brief Gives up the chain of a coroutine discarded while suspended,
+  /// `promise` being its own if it is a `Task`. Each task of the chain
+  /// arrives as if it had completed, and `root` is destroyed once no thread
+  /// is in `Start` for any of them; a thread still there takes over instead.
+  static void Abandon(TaskPromiseBase* promise, std::coroutine_handle<> root) {
+    while (promise != nullptr) {
+      TaskPromiseBase* parent = promise->parent_;
+      promise->abandoned_ = true;
+      if (!promise->Arrive()) {
+        return;
+      }
+      promise = parent;
+    }
+    if (root) {
+      root.destroy();
+    }
+  }
+
+ protected:
+  /// @brief Rethrows the exception of the coroutine, if any.
+  void Check() {
+    if (exception_ != nullptr) {
+      std::rethrow_exception(exception_);
+    }
+  }
+
+ private:
+  /// @brief Called by the starting thread and on completion, returns true
+  /// for the second one, which then resumes the continuation. A task that
+  /// completes right away thus never nests a resumption into the stack, even
+  /// without the tail calls symmetric transfer relies on.
+  bool Arrive() { return arrived_.exchange(true, std::memory_order_acq_rel); }
+
+  std::coroutine_handle<> continuation_{std::noop_coroutine()};
+  TaskPromiseBase* parent_{nullptr};
+  std::coroutine_handle<> root_;
+  std::exception_ptr exception_;
+  std::atomic<bool> arrived_{false};
+  /// @brief Set by `Abandon` before it arrives.
+  bool abandoned_{false};
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+ public:
+  Task<T> get_return_object();
+  void return_value(T value) { value_.emplace(std::move(value)); }
+  T TakeValue() {
+    Check();
+    return std::move(*value_);
+  }
+
+ private:
+  std::optional<T> value_;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+ public:
+  Task<void> get_return_object();
+  void return_void() const noexcept {}
+  void TakeValue() { Check(); }
+};
+
+/// @brief Coroutine that starts right away and frees itself when done.
+class DetachedCoroutine {
+ public:
+  class promise_type : public Pooled<promise_type> {
+   public:
+    DetachedCoroutine get_return_object() const noexcept { return {}; }
+    std::suspend_never initial_suspend() const noexcept { return {}; }
+    std::suspend_never final_suspend() const noexcept { return {}; }
+    void return_void() const noexcept {}
+    void unhandled_exception() const noexcept { std::terminate(); }
+  };
+};
+
+/// @brief The coroutine to destroy to free the chain `coroutine` belongs
+/// to: itself if detached, the root of a chain of `Task`s, null for other
+/// coroutines, whose owners are not known.
+template <typename P>
+std::coroutine_handle<> ChainRoot(std::coroutine_handle<P> coroutine) {
+  if constexpr (std::is_base_of<TaskPromiseBase, P>::value) {
+    return coroutine.promise().root();
+  } else if constexpr (std::is_same<P, DetachedCoroutine::promise_type>::value) {
+    return coroutine;
+  } else {
+    return nullptr;
+  }
+}
+/// @brief The promise of `coroutine` if it is a `Task`, null otherwise.
+template <typename P>
+TaskPromiseBase* ChainPromise(std::coroutine_handle<P> coroutine) {
+  if constexpr (std::is_base_of<TaskPromiseBase, P>::value) {
+    return &coroutine.promise();
+  } else {
+    return nullptr;
+  }
+}
+
+}  // namespace detail
+
+/// @brief A lazily started coroutine producing a `T`.
+///
+/// The body starts when the `Task` is `co_await`ed, on the awaiting thread,
+/// and the awaiting coroutine resumes on the thread that completes it, without
+/// blocking any thread. Use `co_await pool.Schedule()` inside the body to move
+/// to a thread of a pool, and `ThreadPool::Spawn` to start a `Task` from code
+/// that is not a coroutine. Exceptions of the body are rethrown by
+/// `co_await`. A `Task` owns its coroutine and is awaited at most once.
+/// @tparam T The result type, stored by value.
+template <typename T>
+class Task {
+ public:
+  using promise_type = detail::TaskPromise<T>;
+
+  /// @brief Starts the coroutine and suspends the awaiting one until done.
+  class Awaiter {
+   public:
+    explicit Awaiter(std::coroutine_handle<promise_type> coroutine)
+        : coroutine_{coroutine} {}
+    bool await_ready() const noexcept { return coroutine_.done(); }
+    template <typename P>
+    bool await_suspend(std::coroutine_handle<P> awaiting) {
+      return coroutine_.promise().Start(coroutine_, awaiting,
+                                        detail::ChainPromise(awaiting),
+                                        detail::ChainRoot(awaiting));
+    }
+    T await_resume() { return coroutine_.promise().TakeValue(); }
+
+   private:
+    std::coroutine_handle<promise_type> coroutine_;
+  };
+
+  Task() = default;
+  Task(Task&& other) noexcept : coroutine_{other.coroutine_} {
+    other.coroutine_ = nullptr;
+  }
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      coroutine_ = other.coroutine_;
+      other.coroutine_ = nullptr;
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task() { Reset(); }
+
+  bool valid() const { return static_cast<bool>(coroutine_); }
+  Awaiter operator co_await() const noexcept { return Awaiter{coroutine_}; }
+
+ private:
+  friend class detail::TaskPromise<T>;
+
+  explicit Task(std::coroutine_handle<promise_type> coroutine)
+      : coroutine_{coroutine} {}
+  void Reset() {
+    if (coroutine_) {
+      coroutine_.destroy();
+      coroutine_ = nullptr;
+    }
+  }
+
+  std::coroutine_handle<promise_type> coroutine_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>{std::coroutine_handle<TaskPromise>::from_promise(*this)};
+}
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>{std::coroutine_handle<TaskPromise>::from_promise(*this)};
+}
+
+}  // namespace detail
+#endif  // TINY_TP_COROUTINES
+
+/// @brief Handle of a timer scheduled on a `ThreadPool`.
+///
+/// Dropping the handle does not cancel the timer. A default-constructed
+/// `Timer`, or one returned after `ThreadPool::Shutdown`, is not `valid()`.
+/// Must not be used after its `ThreadPool` is destroyed.
+class Timer {
+ public:
+  Timer() = default;
+  Timer(Timer&& other) noexcept : wheel_{other.wheel_}, node_{other.node_} {
+    other.node_ = nullptr;
+  }
+  Timer& operator=(Timer&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      wheel_ = other.wheel_;
+      node_ = other.node_;
+      other.node_ = nullptr;
+    }
+    return *this;
+  }
+  Timer(const Timer&) = delete;
+  Timer& operator=(const Timer&) = delete;
+  ~Timer() { Reset(); }
+
+  bool valid() const { return node_ != nullptr; }
+  /// @brief Stops the timer from firing again, in O(1). A running callback
+  /// is not interrupted.
+  /// @return True if this prevented a pending run.
+  bool Cancel() { return node_ != nullptr && wheel_->Cancel(node_); }
+
+ private:
+  template <typename, typename, typename, typename>
+  friend class BasicThreadPool;
+
+  Timer(detail::TimerWheel* wheel, detail::TimerWheel::Node* node)
+      : wheel_{wheel}, node_{node} {}
+  void Reset() {
+    if (node_ != nullptr) {
+      node_->Release();
+      node_ = nullptr;
+    }
+  }
+
+  detail::TimerWheel* wheel_{nullptr};
+  detail::TimerWheel::Node* node_{nullptr};
+};
+
+/// @brief A pool of credits that limits how many tasks of a group of
+/// producers can be queued or running at once.
+///
+/// Pass it to `ThreadPool::DropWait` or `ThreadPool::DropFor`: each task
+/// holds one credit from admission until it finishes, and producers wait for
+/// a credit when none is left. Must outlive the tasks admitted with it.
+class AdmissionCredits {
+ public:
+  explicit AdmissionCredits(std::size_t credits) : available_{credits} {}
+  AdmissionCredits(const AdmissionCredits&) = delete;
+  AdmissionCredits& operator=(const AdmissionCredits&) = delete;
+
+  /// @brief Takes a credit, waiting until `deadline` for one.
+  /// @return False if no credit became available in time.
+  bool AcquireUntil(const std::chrono::steady_clock::time_point& deadline) {
+    while (!TryAcquire()) {
+      auto key = event_.PrepareWait();
+      if (available_.load(std::memory_order_relaxed) != 0) {
+        event_.CancelWait();
+        continue;
+      }
+      if (deadline == std::chrono::steady_clock::time_point::max()) {
+        event_.Wait(key);
+      } else if (!event_.WaitUntil(key, deadline)) {
+        return TryAcquire();
+      }
+    }
+    return true;
+  }
+  bool TryAcquire() {
+    auto available = available_.load(std::memory_order_relaxed);
+    while (available != 0) {
+      if (available_.compare_exchange_weak(available, available - 1,
+                                           std::memory_order_acquire)) {
+        return true;
+      }
+    }
+    return false;
+  }
+  void Release() {
+    available_.fetch_add(1, std::memory_order_release);
+    if (event_.HasWaiters()) {
+      event_.NotifyOne();
+    }
+  }
+  /// @brief Number of credits left (non-blocking).
+  std::size_t available() const {
+    return available_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<std::size_t> available_;
+  detail::EventCount event_;
+};
+
+/// @brief Counts fire-and-forget tasks so that they can be waited for as a
+/// whole, see `ThreadPool::Post`.
+///
+/// Each task counts from admission until it returns or is discarded. Only
+/// the task that may be the last one takes the lock, the others just
+/// decrement the counter. The group can be reused once empty, and its
+/// destructor waits until it is.
+class TaskGroup {
+ public:
+  TaskGroup() = default;
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+  ~TaskGroup() {
+    std::unique_lock<std::mutex> unique_lock{mtx_};
+    cond_.wait(unique_lock, [this]() { return IsEmpty(); });
+  }
+
+  /// @brief Blocks until every task added so far has returned. Waiting from
+  /// a thread of the pool blocks it, `ThreadPool::WaitFor` helps instead.
+  /// @throw The first exception a task threw since the last `Wait`.
+  void Wait() {
+    std::exception_ptr error;
+    {
+      std::unique_lock<std::mutex> unique_lock{mtx_};
+      cond_.wait(unique_lock, [this]() { return IsEmpty(); });
+      error.swap(error_);
+    }
+    if (error != nullptr) {
+      std::rethrow_exception(error);
+    }
+  }
+  /// @brief Number of tasks not done yet (non-blocking).
+  std::size_t pending() const {
+    return pending_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  template <typename, typename, typename, typename>
+  friend class BasicThreadPool;
+
+  bool IsEmpty() const {
+    return pending_.load(std::memory_order_acquire) == 0;
+  }
+  /// @brief Like `IsEmpty`, but also waits for the last task to let go.
+  bool IsDone() {
+    std::lock_guard<std::mutex> guard{mtx_};
+    return IsEmpty();
+  }
+  void Add() { pending_.fetch_add(1, std::memory_order_relaxed); }
+  void Fail(std::exception_ptr error) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    if (error_ == nullptr) {
+      error_ = std::move(error);
+    }
+  }
+  void Done() {
+    auto pending = pending_.load(std::memory_order_relaxed);
+    while (pending > 1) {
+      if (pending_.compare_exchange_weak(pending, pending - 1,
+                                         std::memory_order_acq_rel)) {
+        return;
+      }
+    }
+    // Reaching zero only under the lock keeps waiters from destroying the
+    // group before this is done with it.
+    std::lock_guard<std::mutex> guard{mtx_};
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      cond_.notify_all();
+      wakers_.NotifyAll();
+    }
+  }
+  /// @brief Makes the last task also signal `waker`, until `RemoveWaker`.
+  void AddWaker(detail::WakerList::Entry* waker) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    wakers_.Add(waker);
+  }
+  void RemoveWaker(detail::WakerList::Entry* waker) {
+    std::lock_guard<std::mutex> guard{mtx_};
+    wakers_.Remove(waker);
+  }
+
+  std::atomic<std::size_t> pending_{0};
+  /// @brief Guarded by `mtx_`.
+  detail::WakerList wakers_;
+  std::exception_ptr error_;
+  std::mutex mtx_;
+  std::condition_variable cond_;
+};
+
+namespace detail {
+class RelaxedHistogram;
+}  // namespace detail
+
+/// @brief Log-linear histogram of durations (HDR-style), the relative error
+/// of a recorded value is below 1/16.
+class Histogram {
+ public:
+  static constexpr unsigned kSubBits{4};
+  static constexpr std::size_t kNumBuckets{(64 - kSubBits + 1) << kSubBits};
+
+  Histogram() : buckets_(kNumBuckets, 0) {}
+
+  /// @brief Returns the bucket of `nanoseconds`, values below 16 ns have
+  /// exact buckets.
+  static std::size_t BucketOf(std::uint64_t nanoseconds) {
+    if (nanoseconds < (std::uint64_t{1} << kSubBits)) {
+      return static_cast<std::size_t>(nanoseconds);
+    }
+    unsigned log = detail::FloorLog2(nanoseconds);
+    auto sub = (nanoseconds >> (log - kSubBits)) &
+               ((std::uint64_t{1} << kSubBits) - 1);
+    return (static_cast<std::size_t>(log - kSubBits + 1) << kSubBits) +
+           static_cast<std::size_t>(sub);
+  }
+  /// @brief Returns the smallest value, in nanoseconds, of `bucket`.
+  static std::uint64_t LowerBound(std::size_t bucket) {
+    std::size_t group = bucket >> kSubBits;
+    std::uint64_t sub = bucket & ((std::size_t{1} << kSubBits) - 1);
+    if (group == 0) {
+      return sub;
+    }
+    return ((std::uint64_t{1} << kSubBits) + sub) << (group - 1);
+  }
+
+  void Record(std::uint64_t nanoseconds) {
+    ++buckets_[BucketOf(nanoseconds)];
+    ++count_;
+    sum_ += nanoseconds;
+    max_ = std::max(max_, nanoseconds);
+  }
+  void Merge(const Histogram& other) {
+    for (std::size_t i = 0; i < kNumBuckets; ++i) {
+      buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+  }
+
+  std::uint64_t count() const { return count_; }
+  std::chrono::nanoseconds max() const {
+    return std::chrono::nanoseconds{static_cast<std::int64_t>(max_)};
+  }
+  std::chrono::nanoseconds Mean() const {
+    return std::chrono::nanoseconds{
+        count_ == 0 ? 0 : static_cast<std::int64_t>(sum_ / count_)};
+  }
+  /// @brief Returns the value below which a `fraction` (0 to 1) of the
+  /// recorded values fall, rounded to its bucket.
+  std::chrono::nanoseconds Percentile(double fraction) const {
+    if (count_ == 0) {
+      return std::chrono::nanoseconds::zero();
+    }
+    auto rank =
+        static_cast<std::uint64_t>(fraction * static_cast<double>(count_));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kNumBuckets; ++i) {
+      seen += buckets_[i];
+      if (seen > rank) {
+        auto value = std::min(LowerBound(i), max_);
+        return std::chrono::nanoseconds{static_cast<std::int64_t>(value)};
+      }
+    }
+    return max();
+  }
+  /// @brief Number of values per bucket, see `LowerBound`.
+  const std::vector<std::uint64_t>& buckets() const { return buckets_; }
+
+ private:
+  friend class detail::RelaxedHistogram;
+
+  std::vector<std::uint64_t> buckets_;
+  std::uint64_t count_{0};
+  std::uint64_t sum_{0};
+  std::uint64_t max_{0};
+};
+
+/// @brief Counters of one thread of a `ThreadPool`.
+struct WorkerStats {
+  std::uint64_t tasks_executed{0};
+  /// @brief Tasks taken from the local deques of other threads.
+  std::uint64_t steals{0};
+  /// @brief Times the thread blocked for lack of tasks.
+  std::uint64_t parks{0};
+  /// @brief Times it was woken up by a notification, not a timeout.
+  std::uint64_t unparks{0};
+};
+
+/// @brief Snapshot of a `ThreadPool`, see `ThreadPool::Stats`.
+struct PoolStats {
+  /// @brief One entry per thread slot.
+  std::vector<WorkerStats> workers;
+  /// @brief Sum of `workers`.
+  WorkerStats total;
+  /// @brief Enqueue attempts rejected because the queue was full or the pool
+  /// was stopping.
+  std::uint64_t rejected{0};
+  /// @brief Time from enqueue to start of the executed tasks.
+  Histogram wait_time;
+  /// @brief Execution time of the executed tasks.
+  Histogram run_time;
+  /// @brief Since construction, to turn counters into rates.
+  std::chrono::steady_clock::duration uptime{};
+  std::uint32_t threads{0};
+  std::size_t idle_threads{0};
+  std::size_t queued_tasks{0};
+};
+
+namespace detail {
+
+/// @brief Counter written by a single thread and read by any.
+class RelaxedCounter {
+ public:
+  void Add(std::uint64_t count = 1) {
+    value_.store(value_.load(std::memory_order_relaxed) + count,
+                 std::memory_order_relaxed);
+  }
+  std::uint64_t Load() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<std::uint64_t> value_{0};
+};
+
+/// @brief `Histogram` written by a single thread and read by any.
+class RelaxedHistogram {
+ public:
+  void Record(std::chrono::steady_clock::duration duration) {
+    auto nanoseconds = static_cast<std::uint64_t>(std::max<std::int64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(),
+        0));
+    buckets_[Histogram::BucketOf(nanoseconds)].Add();
+    sum_.Add(nanoseconds);
+    if (nanoseconds > max_.load(std::memory_order_relaxed)) {
+      max_.store(nanoseconds, std::memory_order_relaxed);
+    }
+  }
+  /// @brief Adds the values recorded so far to `histogram`.
+  void AddTo(Histogram& histogram) const {
+    for (std::size_t i = 0; i < Histogram::kNumBuckets; ++i) {
+      std::uint64_t count = buckets_[i].Load();
+      histogram.buckets_[i] += count;
+      histogram.count_ += count;
+    }
+    histogram.sum_ += sum_.Load();
+    histogram.max_ =
+        std::max(histogram.max_, max_.load(std::memory_order_relaxed));
+  }
+
+ private:
+  RelaxedCounter buckets_[Histogram::kNumBuckets];
+  RelaxedCounter sum_;
+  std::atomic<std::uint64_t> max_{0};
+};
+
+/// @brief Statistics collected by one thread of a `ThreadPool`.
+struct WorkerCounters {
+  RelaxedCounter tasks_executed;
+  RelaxedCounter steals;
+  RelaxedCounter parks;
+  RelaxedCounter unparks;
+  RelaxedHistogram wait_time;
+  RelaxedHistogram run_time;
+};
+/// @brief Stands in for `WorkerCounters` in pools that collect no
+/// statistics: every member is empty, records nothing and reads zero.
+struct NoWorkerCounters {
+  struct Counter {
+    void Add(std::uint64_t = 1) {}
+    std::uint64_t Load() const { return 0; }
+  };
+  struct Recorder {
+    void Record(std::chrono::steady_clock::duration) {}
+    void AddTo(Histogram&) const {}
+  };
+  Counter tasks_executed;
+  Counter steals;
+  Counter parks;
+  Counter unparks;
+  Recorder wait_time;
+  Recorder run_time;
+};
+
+/// @brief Event of a `TraceRing`, timestamps are `ReadTsc` ticks.
+struct TraceEvent {
+  enum class Kind : std::uint8_t {
+    /// @brief A task ran from `start` to `end`, enqueued at `enqueued`, or 0
+    /// if unknown.
+    kRun,
+    /// @brief A task was stolen at `start` from the thread `victim`.
+    kSteal,
+  };
+
+  Kind kind;
+  const char* label;
+  std::uint32_t victim;
+  std::uint64_t enqueued;
+  std::uint64_t start;
+  std::uint64_t end;
+};
+
+/// @brief Latest events of one thread, the oldest are overwritten.
+///
+/// Written by a single thread and read by any, like a seqlock: the writer
+/// claims a slot before overwriting it, and readers drop the slots claimed
+/// while they were copying them.
+class TraceRing {
+ public:
+  /// @brief Allocates room for `capacity` (rounded up to a power of two)
+  /// events, before the writer starts. Records nothing without.
+  void Reserve(std::size_t capacity) {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots_.reset(new Slot[size]);
+    mask_ = size - 1;
+  }
+  void Record(const TraceEvent& event) {
+    if (slots_ == nullptr) {
+      return;
+    }
+    auto head = head_.load(std::memory_order_relaxed);
+    claimed_.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Slot& slot = slots_[head & mask_];
+    slot.kind.store(event.kind, std::memory_order_relaxed);
+    slot.label.store(event.label, std::memory_order_relaxed);
+    slot.victim.store(event.victim, std::memory_order_relaxed);
+    slot.enqueued.store(event.enqueued, std::memory_order_relaxed);
+    slot.start.store(event.start, std::memory_order_relaxed);
+    slot.end.store(event.end, std::memory_order_relaxed);
+    head_.store(head + 1, std::memory_order_release);
+  }
+  /// @brief Appends the recorded events to `events`, oldest first.
+  void Snapshot(std::vector<TraceEvent>& events) const {
+    if (slots_ == nullptr) {
+      return;
+    }
+    const std::uint64_t capacity = mask_ + 1;
+    auto head = head_.load(std::memory_order_acquire);
+    auto first = head > capacity ? head - capacity : 0;
+    std::size_t begin = events.size();
+    for (auto i = first; i < head; ++i) {
+      const Slot& slot = slots_[i & mask_];
+      events.push_back(TraceEvent{
+          slot.kind.load(std::memory_order_relaxed),
+          slot.label.load(std::memory_order_relaxed),
+          slot.victim.load(std::memory_order_relaxed),
+          slot.enqueued.load(std::memory_order_relaxed),
+          slot.start.load(std::memory_order_relaxed),
+          slot.end.load(std::memory_order_relaxed)});
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Slots overwritten while they were copied may be torn.
+    auto claimed = claimed_.load(std::memory_order_relaxed);
+    if (claimed > first + capacity) {
+      auto torn = static_cast<std::size_t>(
+          std::min<std::uint64_t>(claimed - capacity - first, head - first));
+      events.erase(events.begin() + static_cast<std::ptrdiff_t>(begin),
+                   events.begin() + static_cast<std::ptrdiff_t>(begin + torn));
+    }
+  }
+
+ private:
+  struct Slot {
+    std::atomic<TraceEvent::Kind> kind{TraceEvent::Kind::kRun};
+    std::atomic<const char*> label{nullptr};
+    std::atomic<std::uint32_t> victim{0};
+    std::atomic<std::uint64_t> enqueued{0};
+    std::atomic<std::uint64_t> start{0};
+    std::atomic<std::uint64_t> end{0};
+  };
+
+  std::unique_ptr<Slot[]> slots_;
+  std::uint64_t mask_{0};
+  std::atomic<std::uint64_t> claimed_{0};
+  std::atomic<std::uint64_t> head_{0};
+};
+
+/// @brief Writes `text` as a JSON string.
+inline void WriteJsonString(std::ostream& out, const char* text) {
+  out << '"';
+  for (; *text != '\0'; ++text) {
+    auto c = static_cast<unsigned char>(*text);
+    if (c == '"' || c == '\\') {
+      out << '\\' << *text;
+    } else if (c < 0x20) {
+      static const char kHex[] = "0123456789abcdef";
+      out << "\\u00" << kHex[c >> 4] << kHex[c & 0xF];
+    } else {
+      out << *text;
+    }
+  }
+  out << '"';
+}
+/// @brief Writes `nanoseconds` as microseconds with three decimals.
+inline void WriteMicros(std::ostream& out, std::uint64_t nanoseconds) {
+  auto fraction = nanoseconds % 1000;
+  out << nanoseconds / 1000 << '.' << fraction / 100 << fraction / 10 % 10
+      << fraction % 10;
+}
+
+}  // namespace detail
+
+/// @brief Bump allocator for temporary memory of tasks.
+///
+/// Every thread has one, see `ThreadPool::Scratch`, and the threads of a
+/// `ThreadPool` rewind it after each task, so tasks get scratch buffers
+/// without touching the global allocator nor sharing memory with other
+/// threads. Memory is handed out from chunks that are kept for later tasks;
+/// after a task needed several chunks, they are merged into one. Nothing is
+/// constructed nor destroyed: store trivially destructible data, or use
+/// containers with a `ScratchAllocator` that are destroyed before the task
+/// returns.
+class ScratchArena {
+ public:
+  static constexpr std::size_t kFirstChunkSize{64 * 1024};
+  /// @brief Chunks are not merged beyond this size, but freed instead.
+  static constexpr std::size_t kMaxRetainedSize{16 * 1024 * 1024};
+
+  /// @brief A position to rewind to.
+  struct Mark {
+    std::size_t chunk;
+    std::size_t offset;
+  };
+
+  ScratchArena() = default;
+  ScratchArena(const ScratchArena&) = delete;
+  ScratchArena& operator=(const ScratchArena&) = delete;
+
+  /// @brief Returns `size` bytes aligned to `align`, a power of two, valid
+  /// until the arena is rewound past them.
+  void* Allocate(std::size_t size,
+                 std::size_t align = alignof(std::max_align_t)) {
+    while (true) {
+      if (chunk_ < chunks_.size()) {
+        Chunk& chunk = chunks_[chunk_];
+        auto base = reinterpret_cast<std::uintptr_t>(chunk.data.get());
+        std::size_t start =
+            ((base + offset_ + align - 1) & ~(std::uintptr_t{align} - 1)) -
+            base;
+        if (start + size <= chunk.size) {
+          offset_ = start + size;
+          return chunk.data.get() + start;
+        }
+      }
+      // Move on to the next chunk, inserting one if it is too small.
+      std::size_t next = chunks_.empty() ? 0 : chunk_ + 1;
+      if (next == chunks_.size() || chunks_[next].size < size + align) {
+        std::size_t grown =
+            chunks_.empty() ? kFirstChunkSize : 2 * chunks_[chunk_].size;
+        chunks_.insert(chunks_.begin() + static_cast<std::ptrdiff_t>(next),
+                       Chunk{std::max(grown, size + align)});
+      }
+      chunk_ = next;
+      offset_ = 0;
+    }
+  }
+  /// @brief Returns uninitialized storage for `n` objects of type `T`.
+  template <typename T>
+  T* AllocateArray(std::size_t n) {
+    return static_cast<T*>(Allocate(n * sizeof(T), alignof(T)));
+  }
+  Mark GetMark() const { return Mark{chunk_, offset_}; }
+  /// @brief Releases everything allocated after `mark` was taken.
+  void Rewind(const Mark& mark) {
+    chunk_ = mark.chunk;
+    offset_ = mark.offset;
+    if (mark.chunk != 0 || mark.offset != 0) {
+      return;
+    }
+    // Merge several chunks into one, and never keep more than
+    // `kMaxRetainedSize`, even if one huge allocation made a single chunk.
+    std::size_t total = capacity();
+    if (chunks_.size() > 1 || total > kMaxRetainedSize) {
+      chunks_.clear();
+      chunks_.push_back(
+          Chunk{total < kMaxRetainedSize ? total : kMaxRetainedSize});
+    }
+  }
+  /// @brief Releases everything allocated so far.
+  void Reset() { Rewind(Mark{0, 0}); }
+  /// @brief Bytes held by the arena.
+  std::size_t capacity() const {
+    std::size_t total = 0;
+    for (const auto& chunk : chunks_) {
+      total += chunk.size;
+    }
+    return total;
+  }
+
+ private:
+  struct Chunk {
+    explicit Chunk(std::size_t bytes)
+        : data{new unsigned char[bytes]}, size{bytes} {}
+    std::unique_ptr<unsigned char[]> data;
+    std::size_t size;
+  };
+
+  std::vector<Chunk> chunks_;
+  std::size_t chunk_{0};
+  std::size_t offset_{0};
+};
+
+/// @brief Standard allocator drawing from a `ScratchArena`. Deallocation is
+/// a no-op, the memory is reclaimed when the arena is rewound.
+template <typename T>
+class ScratchAllocator {
+ public:
+  using value_type = T;
+
+  explicit ScratchAllocator(ScratchArena& arena) noexcept : arena_{&arena} {}
+  template <typename U>
+  ScratchAllocator(const ScratchAllocator<U>& other) noexcept
+      : arena_{other.arena_} {}
+
+  T* allocate(std::size_t n) { return arena_->AllocateArray<T>(n); }
+  void deallocate(T*, std::size_t) noexcept {}
+
+ private:
+  template <typename U>
+  friend class ScratchAllocator;
+  template <typename U, typename V>
+  friend bool operator==(const ScratchAllocator<U>&,
+                         const ScratchAllocator<V>&) noexcept;
+
+  ScratchArena* arena_;
+};
+template <typename T, typename U>
+bool operator==(const ScratchAllocator<T>& a,
+                const ScratchAllocator<U>& b) noexcept {
+  return a.arena_ == b.arena_;
+}
+template <typename T, typename U>
+bool operator!=(const ScratchAllocator<T>& a,
+                const ScratchAllocator<U>& b) noexcept {
+  return !(a == b);
+}
+
+namespace detail {
+
+/// @brief The `ScratchArena` of the calling thread, shared by all pools.
+inline ScratchArena& ThreadScratch() {
+  static thread_local ScratchArena arena;
+  return arena;
+}
+
+}  // namespace detail
+
+/// @brief Names the tasks a thread submits while it lives, in the traces of
+/// `ThreadPool::WriteTrace`. Tasks submitted by a running task inherit its
+/// name unless they are labeled themselves. `label` must stay valid until
+/// the trace is written, string literals are best.
+class TraceLabel {
+ public:
+  explicit TraceLabel(const char* label) : outer_{Current()} {
+    Current() = label;
+  }
+  TraceLabel(const TraceLabel&) = delete;
+  TraceLabel& operator=(const TraceLabel&) = delete;
+  ~TraceLabel() { Current() = outer_; }
+
+ private:
+  template <typename, typename, typename, typename>
+  friend class BasicThreadPool;
+
+  /// @brief Label of the tasks the calling thread submits, null if none.
+  static const char*& Current() {
+    static thread_local const char* label = nullptr;
+    return label;
+  }
+
+  const char* const outer_;
+};
+
+class TaskGraph;
+template <typename Pool>
+class BasicStrand;
+class Executor;
+
+// Policies of `BasicThreadPool`. Each fixes at compile time what `ThreadPool`
+// decides from its `Options` or always does, so that a pool configured for
+// one use only compiles the code it runs.
+
+/// @brief Takes the shared queue from `Options::queue_backend`.
+struct OptionsQueue {
+  template <typename Task>
+  using Queue = detail::SharedQueue<Task>;
+
+  static constexpr QueueBackend Backend(QueueBackend configured) {
+    return configured;
+  }
+  template <typename Task>
+  static Queue<Task>* Make(QueueBackend configured, std::size_t capacity,
+                           std::chrono::steady_clock::duration aging) {
+    return new Queue<Task>{configured, capacity, aging};
+  }
+};
+/// @brief Always uses `QueueBackend::kLocked`.
+struct LockedQueue {
+  template <typename Task>
+  using Queue = detail::PriorityQueue<Task>;
+
+  static constexpr QueueBackend Backend(QueueBackend) {
+    return QueueBackend::kLocked;
+  }
+  template <typename Task>
+  static Queue<Task>* Make(QueueBackend, std::size_t capacity,
+                           std::chrono::steady_clock::duration aging) {
+    return new Queue<Task>{capacity, aging};
+  }
+};
+/// @brief Always uses `QueueBackend::kLockFree`.
+struct LockFreeQueue {
+  template <typename Task>
+  using Queue = detail::RingQueue<Task>;
+
+  static constexpr QueueBackend Backend(QueueBackend) {
+    return QueueBackend::kLockFree;
+  }
+  template <typename Task>
+  static Queue<Task>* Make(QueueBackend, std::size_t capacity,
+                           std::chrono::steady_clock::duration aging) {
+    return new Queue<Task>{capacity, aging};
+  }
+};
+
+/// @brief Collects the results of `ITask::Execute` for `GrabAllResults`.
+struct KeepResults {
+  static constexpr bool Keep() { return true; }
+};
+/// @brief Destroys the results of `ITask::Execute` right away, for pools
+/// whose tasks report their results by other means.
+struct DiscardResults {
+  static constexpr bool Keep() { return false; }
+};
+
+/// @brief Takes the idle policy from `Options::idle_policy`.
+struct OptionsIdle {
+  static constexpr IdlePolicy Policy(IdlePolicy configured) {
+    return configured;
+  }
+};
+/// @brief Always uses `P`, ignoring `Options::idle_policy`.
+template <IdlePolicy P>
+struct FixedIdle {
+  static constexpr IdlePolicy Policy(IdlePolicy) { return P; }
+};
+
+/// @brief Collects the counters and histograms of `Stats`, and stamps every
+/// task with its enqueue time for them.
+struct CollectStats {
+  static constexpr bool Collect() { return true; }
+};
+/// @brief Collects no statistics, so tasks and threads carry no bookkeeping.
+struct NoStats {
+  static constexpr bool Collect() { return false; }
+};
+/// @brief `CollectStats` if `TINY_TP_STATS` is 1, `NoStats` otherwise.
+using DefaultStats =
+    std::conditional<TINY_TP_STATS != 0, CollectStats, NoStats>::type;
+
+template <typename QueuePolicy = OptionsQueue,
+          typename TaskPolicy = KeepResults,
+          typename IdleStrategy = OptionsIdle,
+          typename StatsPolicy = DefaultStats>
+class BasicThreadPool;
+
+/// @brief The thread pool configured at run time by its `Options`.
+using ThreadPool = BasicThreadPool<>;
+
+/// @brief A thread pool class for executing tasks concurrently.
+///
+/// `ThreadPool` is the most flexible configuration. The policies make others
+/// that skip the configuration checks and bookkeeping they do not need, e.g.
+/// `BasicThreadPool<LockFreeQueue, DiscardResults,
+/// FixedIdle<IdlePolicy::kSpinYieldPark>, NoStats>`.
+template <typename QueuePolicy, typename TaskPolicy, typename IdleStrategy,
+          typename StatsPolicy>
+class BasicThreadPool {
+ public:
+  /// @brief Default maximum queue size for the `ThreadPool`.
+  static constexpr std::uint32_t kDefaultMaxQueueSize{65535};
+
+  /// @brief Construction options for the `ThreadPool`.
+  struct Options {
+    /// @brief The number of threads in the `ThreadPool`, the minimum number
+    /// of threads if the pool is elastic.
+    std::uint32_t num_threads{std::thread::hardware_concurrency()};
+    /// @brief Makes the pool elastic if greater than `num_threads`: when all
+    /// threads are busy and at least `grow_queue_depth` tasks wait, another
+    /// thread is started, up to `max_threads`.
+    std::uint32_t max_threads{0};
+    /// @brief Number of waiting tasks that makes an elastic pool grow.
+    std::uint32_t grow_queue_depth{1};
+    /// @brief How long a thread of an elastic pool stays idle before it
+    /// exits, as long as more than `num_threads` threads are running.
+    std::chrono::steady_clock::duration keep_alive{std::chrono::seconds{30}};
+    /// @brief The maximum size of each task queue.
+    std::uint32_t max_queue_size{kDefaultMaxQueueSize};
+    /// @brief How tasks are distributed among threads.
+    Scheduling scheduling{Scheduling::kGlobalQueue};
+    /// @brief Implementation of the shared queue. `QueueBackend::kLockFree`
+    /// preallocates three rings of `max_queue_size` (rounded up to a power of
+    /// two) slots of about 80 bytes each.
+    QueueBackend queue_backend{QueueBackend::kLocked};
+    /// @brief How long a task waits before it overtakes the tasks of the next
+    /// more urgent priority level, `duration::max()` disables aging along
+    /// with the clock read it needs on every enqueue.
+    std::chrono::steady_clock::duration priority_aging{
+        std::chrono::milliseconds{100}};
+    /// @brief Resolution of timers, they fire at most one tick late.
+    std::chrono::steady_clock::duration timer_tick{
+        std::chrono::milliseconds{1}};
+    /// @brief Where threads run. Pinning is only supported on Linux; on other
+    /// systems `Placement::kNumaNodes` keeps a single node.
+    Placement placement{Placement::kAny};
+    /// @brief CPUs for `Placement::kCpuList`.
+    std::vector<unsigned> cpus;
+    /// @brief What idle threads do before blocking. Spinning trades CPU time
+    /// for microsecond-level wake-up latency and suits dedicated cores.
+    IdlePolicy idle_policy{IdlePolicy::kBlock};
+    /// @brief Number of CPU pause iterations in the spinning phase.
+    std::uint32_t spin_count{4096};
+    /// @brief Number of `std::this_thread::yield` calls in the yielding phase
+    /// of `IdlePolicy::kSpinYieldPark`.
+    std::uint32_t yield_count{64};
+    /// @brief What `Drop`, `Submit` and the batch versions do when the queue
+    /// is full. Waiting versions like `DropWait` and timers never run tasks
+    /// on the calling thread.
+    OverflowPolicy overflow_policy{OverflowPolicy::kReject};
+    /// @brief The most tasks a thread takes from a shared queue at once, and
+    /// whose results it publishes at once. Fewer are taken while the queue is
+    /// short or other threads are idle, 1 takes one task at a time.
+    ///
+    /// Tasks of a batch can only run on the thread that took them. A task
+    /// that blocks in `Future::Wait` or `Get` on a task behind it in the same
+    /// batch deadlocks, where with 1 another thread would have run it. Above
+    /// 1, tasks must wait for other tasks with `WaitFor`, which runs the rest
+    /// of the batch meanwhile.
+    std::uint32_t dequeue_batch{1};
+    /// @brief Threads are named `<thread_name>-<index>`, unnamed if empty.
+    std::string thread_name{"tiny_tp"};
+    /// @brief Called with its index on every thread, before it runs tasks,
+    /// to set up per-thread state. Must not throw.
+    std::function<void(std::uint32_t)> on_thread_start;
+    /// @brief Called with its index on every thread, after its last task,
+    /// including threads of an elastic pool that retire. Must not throw.
+    std::function<void(std::uint32_t)> on_thread_stop;
+    /// @brief Events every thread keeps for `WriteTrace`, the oldest are
+    /// overwritten. Only allocated with `TINY_TP_TRACE`, 48 bytes each.
+    std::uint32_t trace_capacity{1 << 16};
+  };
+
+  /// @brief Constructs a `ThreadPool` from the given options.
+  /// @param options The construction options.
+  explicit BasicThreadPool(const Options& options)
+      : kMaxQueueSize{options.max_queue_size},
+        kNumThreads{options.num_threads},
+        kMaxThreads{std::max(options.num_threads, options.max_threads)},
+        kGrowQueueDepth{options.grow_queue_depth},
+        kKeepAlive{options.keep_alive},
+        kScheduling{options.scheduling},
+        kQueueBackend{options.queue_backend},
+        kIdlePolicy{options.idle_policy},
+        kSpinCount{options.spin_count},
+        kYieldCount{options.yield_count},
+        kTimerTick{options.timer_tick},
+        kOverflowPolicy{options.overflow_policy},
+        kDequeueBatch{std::max<std::uint32_t>(options.dequeue_batch, 1)},
+        kThreadName{options.thread_name},
+        kOnThreadStart{options.on_thread_start},
+        kOnThreadStop{options.on_thread_stop} {
+    // An elastic pool starts its extra threads in the spare slots.
+    for (std::uint32_t i = 0; i < kMaxThreads; ++i) {
+      workers_.emplace_back(new Worker{this, i});
+#if TINY_TP_TRACE
+      workers_.back()->trace.Reserve(options.trace_capacity);
+#endif
+    }
+    Place(options);
+    threads_.resize(kMaxThreads);
+    std::lock_guard<std::mutex> scale_guard{scale_mtx_};
+    // Create the specified number of threads and start them.
+    for (std::uint32_t i = 0; i < kNumThreads; ++i) {
+      StartLocked(workers_[i].get());
+    }
+  }
+  /// @brief Constructs a `ThreadPool` with specified number of threads and
+  /// maximum queue size.
+  /// @param num_threads The number of threads in the `ThreadPool`.
+  /// @param max_queue_size The maximum size of the task queue.
+  BasicThreadPool(std::uint32_t num_threads, std::uint32_t max_queue_size)
+      : BasicThreadPool{MakeOptions(num_threads, max_queue_size)} {}
+  BasicThreadPool() : BasicThreadPool{Options{}} {}
+  explicit BasicThreadPool(std::uint32_t num_threads)
+      : BasicThreadPool{num_threads, kDefaultMaxQueueSize} {};
+  ~BasicThreadPool() { Shutdown(ShutdownMode::kDrain); }
+
+  /// @brief Stops the `ThreadPool` and joins all of its threads (blocking).
+  ///
+  /// From the start of the call, tasks dropped from outside the pool are
+  /// rejected, while tasks dropped by running tasks are still accepted while
+  /// draining. Tasks already running always finish. Calling it again has no
+  /// effect. Must not be called from a thread of this pool.
+  /// @param mode Whether queued tasks are run or discarded.
+  void Shutdown(ShutdownMode mode) {
+    std::lock_guard<std::mutex> shutdown_guard{shutdown_mtx_};
+    if (stopping_.exchange(true, std::memory_order_seq_cst)) {
+      return;
+    }
+    {
+      // Timers never fire again. Ticks already queued still run once in
+      // drain mode, but are not re-armed.
+      std::lock_guard<std::mutex> timers_guard{timers_mtx_};
+      if (timers_ != nullptr) {
+        timers_->Stop();
+      }
+    }
+    // Release blocked producers, they are rejected from now on.
+    space_event_.NotifyAll();
+    if (mode == ShutdownMode::kDrain) {
+      WaitIdle();
+    }
+    quit_.store(true, std::memory_order_seq_cst);
+    idle_event_.NotifyAll();
+    space_event_.NotifyAll();
+    std::vector<std::thread> threads;
+    {
+      // No thread is started from now on, exiting ones may need the lock.
+      std::lock_guard<std::mutex> scale_guard{scale_mtx_};
+      threads.swap(threads_);
+      for (auto& thread : exited_threads_) {
+        threads.push_back(std::move(thread));
+      }
+      exited_threads_.clear();
+    }
+    for (auto& thread : threads) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+    // Only reached with `ShutdownMode::kCancelPending` tasks left behind.
+    for (auto& queue : waiting_queues_) {
+      queue->Clear();
+    }
+    for (auto& worker : workers_) {
+      QueuedTask* task = nullptr;
+      while ((task = worker->deque.Pop()) != nullptr) {
+        delete task;
+      }
+      worker->batch.clear();
+      worker->batch_next = 0;
+    }
+    if (unfinished_.value.exchange(0, std::memory_order_seq_cst) != 0) {
+      done_event_.NotifyAll();
+    }
+  }
+  /// @brief Blocks until every queued and running task has finished. Must not
+  /// be called from a thread of this pool.
+  void WaitIdle() {
+    while (unfinished_.value.load(std::memory_order_seq_cst) != 0) {
+      auto key = done_event_.PrepareWait();
+      if (unfinished_.value.load(std::memory_order_seq_cst) == 0) {
+        done_event_.CancelWait();
+        break;
+      }
+      done_event_.Wait(key);
+    }
+  }
+  /// @brief Returns the scratch arena of the calling thread. On a thread of
+  /// a pool, everything a task allocates from it is released when the task
+  /// returns; on other threads, call `ScratchArena::Reset` when done.
+  static ScratchArena& Scratch() { return detail::ThreadScratch(); }
+  /// @brief Blocks until `future` is ready. Called from a thread of this
+  /// pool, it runs other queued tasks meanwhile instead of blocking, so tasks
+  /// can wait for tasks they submitted without tying up the thread or
+  /// deadlocking the pool.
+  /// @param future A `Future` of a task of any pool. If it is not `valid()`,
+  /// throws like `Future::Wait`.
+  template <typename R>
+  void WaitFor(const Future<R>& future) {
+    detail::FutureStateBase* state = future.CheckedState();
+    if (OwnWorker() == nullptr) {
+      state->Wait();
+      return;
+    }
+    detail::WakerList::Entry waker{&join_event_};
+    state->AddWaker(&waker);
+    HelpUntil([state]() { return state->IsReady(); });
+    state->RemoveWaker(&waker);
+  }
+  /// @brief Like `TaskGroup::Wait`, but a thread of this pool runs other
+  /// queued tasks meanwhile, like `WaitFor` with a `Future`.
+  void WaitFor(TaskGroup& group) {
+    if (OwnWorker() != nullptr) {
+      detail::WakerList::Entry waker{&join_event_};
+      group.AddWaker(&waker);
+      HelpUntil([&group]() { return group.IsDone(); });
+      group.RemoveWaker(&waker);
+    }
+    group.Wait();
+  }
+
+#if TINY_TP_COROUTINES
+  /// @brief Awaitable of `Schedule`.
+  class ScheduleAwaiter {
+   public:
+    ScheduleAwaiter(BasicThreadPool* pool, Priority priority)
+        : pool_{pool}, priority_{priority} {}
+    bool await_ready() const noexcept { return false; }
+    template <typename P>
+    bool await_suspend(std::coroutine_handle<P> coroutine) {
+      // Once enqueued, the coroutine may resume and free this awaiter.
+      scheduled_ = true;
+      QueuedTask call{ResumeCall{coroutine, detail::ChainPromise(coroutine),
+                                 detail::ChainRoot(coroutine)}};
+      if (pool_->EnqueueTask(std::move(call), priority_, false)) {
+        return true;
+      }
+      // Left untouched, the coroutine goes on here instead.
+      call.template Target<ResumeCall>()->Release();
+      scheduled_ = false;
+      return false;
+    }
+    /// @return False if the task was rejected and the coroutine continued on
+    /// the calling thread.
+    bool await_resume() const noexcept { return scheduled_; }
+
+   private:
+    BasicThreadPool* pool_;
+    Priority priority_;
+    bool scheduled_{false};
+  };
+
+  /// @brief Returns an awaitable that suspends the awaiting coroutine and
+  /// resumes it on a thread of this pool, like a task with `priority`.
+  ///
+  /// If the pool rejects it, the coroutine continues on the calling thread
+  /// right away and `co_await` yields false. A coroutine discarded by
+  /// `ShutdownMode::kCancelPending` is destroyed with its chain of `Task`s if
+  /// the chain runs under `Spawn`, other coroutines are left suspended.
+  ScheduleAwaiter Schedule(Priority priority = Priority::kNormal) {
+    return ScheduleAwaiter{this, priority};
+  }
+  /// @brief Starts `task` on a thread of this pool (non-blocking).
+  ///
+  /// If `ShutdownMode::kCancelPending` discards the task while it waits in a
+  /// `Schedule`, its coroutines are destroyed and the `Future` holds a
+  /// `std::future_error` with `std::future_errc::broken_promise`.
+  /// @return A `Future` for the result of `task`.
+  template <typename T>
+  Future<T> Spawn(Task<T> task, Priority priority = Priority::kNormal) {
+    Promise<T> promise;
+    Future<T> future = promise.GetFuture();
+    Drive(this, priority, std::move(task), std::move(promise));
+    return future;
+  }
+#endif  // TINY_TP_COROUTINES
+
+  /// @brief Adds a task to the `ThreadPool` queue (non-blocking).
+  ///
+  /// In `Scheduling::kWorkStealing` mode a `Priority::kNormal` task dropped
+  /// from one of the pool's own threads goes to that thread's local deque,
+  /// otherwise it goes to the shared queue. With
+  /// `OverflowPolicy::kCallerRuns`, a full queue makes the calling thread run
+  /// the task instead.
+  /// @param task The task to be added to the queue.
+  /// @param priority The priority level of the task.
+  /// @return True if the task was successfully added or run, false otherwise.
+  bool Drop(std::shared_ptr<ITask> task,
+            Priority priority = Priority::kNormal) {
+    return EnqueueTask(QueuedTask{ITaskCall{this, std::move(task)}},
+                       priority);
+  }
+  /// @brief Like `Drop`, but the task is discarded without running if
+  /// `token` is cancelled or expires before a thread dequeues it.
+  bool Drop(std::shared_ptr<ITask> task, const CancellationToken& token,
+            Priority priority = Priority::kNormal) {
+    return EnqueueTask(QueuedTask{CancellableCall<ITaskCall>{
+                           ITaskCall{this, std::move(task)}, token}},
+                       priority);
+  }
+  /// @brief Adds a task to the `ThreadPool` queue, waiting for space while
+  /// the queue is full. Waiting from a thread of this pool can deadlock.
+  /// @param task The task to be added to the queue.
+  /// @param priority The priority level of the task.
+  /// @return False only if the pool is shutting down.
+  bool DropWait(std::shared_ptr<ITask> task,
+                Priority priority = Priority::kNormal) {
+    return EnqueueUntil(QueuedTask{ITaskCall{this, std::move(task)}},
+                        priority, std::chrono::steady_clock::time_point::max());
+  }
+  /// @brief Like `DropWait`, but also waits for, and holds until the task
+  /// finishes, one credit of `credits`.
+  bool DropWait(std::shared_ptr<ITask> task, AdmissionCredits& credits,
+                Priority priority = Priority::kNormal) {
+    return DropUntil(std::move(task), credits, priority,
+                     std::chrono::steady_clock::time_point::max());
+  }
+  /// @brief Like `DropWait`, but gives up after `timeout`.
+  /// @return False if the task was not added in time.
+  template <typename Rep, typename Period>
+  bool DropFor(std::shared_ptr<ITask> task,
+               const std::chrono::duration<Rep, Period>& timeout,
+               Priority priority = Priority::kNormal) {
+    return EnqueueUntil(QueuedTask{ITaskCall{this, std::move(task)}},
+                        priority, std::chrono::steady_clock::now() + timeout);
+  }
+  /// @brief Like `DropWait` with credits, but gives up after `timeout`.
+  /// @return False if the task was not added in time.
+  template <typename Rep, typename Period>
+  bool DropFor(std::shared_ptr<ITask> task,
+               const std::chrono::duration<Rep, Period>& timeout,
+               AdmissionCredits& credits,
+               Priority priority = Priority::kNormal) {
+    return DropUntil(std::move(task), credits, priority,
+                     std::chrono::steady_clock::now() + timeout);
+  }
+  /// @brief Adds a callable to the `ThreadPool` queue (non-blocking).
+  ///
+  /// The callable and its arguments are stored by value inside the queue
+  /// node, small ones without any heap allocation. Queue placement follows
+  /// `Drop`.
+  /// @param fn The callable, invoked as `fn(args...)`.
+  /// @param args The arguments, copied or moved into the task.
+  /// @return A `Future` for the result of the callable, not `valid()` if the
+  /// queue is full.
+  template <typename F, typename... Args>
+  Future<detail::ResultOf<F, Args...>> Submit(F&& fn, Args&&... args) {
+    return Submit(Priority::kNormal, std::forward<F>(fn),
+                  std::forward<Args>(args)...);
+  }
+  /// @brief Adds a callable with the given priority level, like `Submit`.
+  template <typename F, typename... Args>
+  Future<detail::ResultOf<F, Args...>> Submit(Priority priority, F&& fn,
+                                              Args&&... args) {
+    using R = detail::ResultOf<F, Args...>;
+    using Call = decltype(
+        detail::Bind(std::forward<F>(fn), std::forward<Args>(args)...));
+    Promise<R> promise;
+    auto future = promise.GetFuture();
+    if (!EnqueueTask(QueuedTask{detail::PromiseCall<R, Call>{
+                             detail::Bind(std::forward<F>(fn),
+                                          std::forward<Args>(args)...),
+                             std::move(promise)}},
+                     priority)) {
+      return Future<R>{};
+    }
+    return future;
+  }
+  /// @brief Like `Submit`, but the callable is discarded without running if
+  /// `token` is cancelled or expires before a thread dequeues it. The
+  /// `Future` then throws `TaskCancelled`.
+  template <typename F, typename... Args>
+  Future<detail::ResultOf<F, Args...>> Submit(const CancellationToken& token,
+                                              F&& fn, Args&&... args) {
+    return Submit(Priority::kNormal, token, std::forward<F>(fn),
+                  std::forward<Args>(args)...);
+  }
+  /// @brief Adds a cancellable callable with the given priority level.
+  template <typename F, typename... Args>
+  Future<detail::ResultOf<F, Args...>> Submit(Priority priority,
+                                              const CancellationToken& token,
+                                              F&& fn, Args&&... args) {
+    using R = detail::ResultOf<F, Args...>;
+    using Call = detail::PromiseCall<R, decltype(detail::Bind(
+                                            std::forward<F>(fn),
+                                            std::forward<Args>(args)...))>;
+    Promise<R> promise;
+    auto future = promise.GetFuture();
+    if (!EnqueueTask(QueuedTask{CancellableCall<Call>{
+                         Call{detail::Bind(std::forward<F>(fn),
+                                           std::forward<Args>(args)...),
+                              std::move(promise)},
+                         token}},
+                     priority)) {
+      return Future<R>{};
+    }
+    return future;
+  }
+  /// @brief Adds a callable whose end nobody waits for (non-blocking).
+  ///
+  /// The cheapest way to run a task: unlike `Submit` there is no `Future`
+  /// to allocate and complete, and unlike `Drop` no result to collect.
+  /// Whatever `fn` returns is discarded, and an exception escaping it ends
+  /// the program like one escaping `ITask::Execute`.
+  /// @return True if the callable was added or run, false otherwise.
+  template <typename F, typename... Args>
+  bool Post(F&& fn, Args&&... args) {
+    return Post(Priority::kNormal, std::forward<F>(fn),
+                std::forward<Args>(args)...);
+  }
+  /// @brief Adds a callable with the given priority level, like `Post`.
+  template <typename F, typename... Args>
+  bool Post(Priority priority, F&& fn, Args&&... args) {
+    return EnqueueTask(QueuedTask{detail::Bind(
+                           std::forward<F>(fn), std::forward<Args>(args)...)},
+                       priority);
+  }
+  /// @brief Like `Post`, but counts the callable in `group` until it
+  /// returns, and keeps the first exception for `TaskGroup::Wait`.
+  template <typename F, typename... Args>
+  bool Post(TaskGroup& group, F&& fn, Args&&... args) {
+    return Post(Priority::kNormal, group, std::forward<F>(fn),
+                std::forward<Args>(args)...);
+  }
+  /// @brief Adds a counted callable with the given priority level.
+  template <typename F, typename... Args>
+  bool Post(Priority priority, TaskGroup& group, F&& fn, Args&&... args) {
+    using Call = decltype(
+        detail::Bind(std::forward<F>(fn), std::forward<Args>(args)...));
+    group.Add();
+    // A rejected call leaves the group on destruction.
+    return EnqueueTask(
+        QueuedTask{GroupCall<Call>{
+            detail::Bind(std::forward<F>(fn), std::forward<Args>(args)...),
+            &group}},
+        priority);
+  }
+  /// @brief Adds a range of tasks to the `ThreadPool` queue (non-blocking).
+  ///
+  /// All tasks are pushed with a single lock acquisition and at most one
+  /// idle thread per task is woken up. If the queue fills up, the tasks at
+  /// the end of the range are rejected.
+  /// @param first, last The range of `std::shared_ptr<ITask>` to be added.
+  /// @param priority The priority level of all the tasks.
+  /// @return The number of tasks added, counted from the start of the range.
+  template <typename InputIt>
+  std::size_t DropBatch(InputIt first, InputIt last,
+                        Priority priority = Priority::kNormal) {
+    std::vector<QueuedTask> batch;
+    for (; first != last; ++first) {
+      batch.emplace_back(ITaskCall{this, *first});
+    }
+    return EnqueueBatch(batch, priority);
+  }
+  /// @brief Adds a range of callables to the `ThreadPool` queue
+  /// (non-blocking), like `DropBatch`.
+  /// @param first, last The range of callables, invoked without arguments.
+  /// Dereferenced elements are copied, or moved with `std::move_iterator`.
+  /// @return One `Future` per added callable, counted from the start of the
+  /// range.
+  template <typename InputIt,
+            typename R = detail::ResultOf<decltype(*std::declval<InputIt&>())>>
+  std::vector<Future<R>> SubmitRange(InputIt first, InputIt last,
+                                     Priority priority = Priority::kNormal) {
+    using F = typename std::decay<decltype(*first)>::type;
+    std::vector<QueuedTask> batch;
+    std::vector<Future<R>> futures;
+    for (; first != last; ++first) {
+      Promise<R> promise;
+      futures.push_back(promise.GetFuture());
+      batch.emplace_back(detail::PromiseCall<R, F>{F(*first), std::move(promise)});
+    }
+    futures.resize(EnqueueBatch(batch, priority));
+    return futures;
+  }
+  /// @brief Calls `fn(i)` for every `i` in [`begin`, `end`) in parallel and
+  /// returns once all calls are done (blocking).
+  ///
+  /// `begin` and `end` are integers or random-access iterators. The range is
+  /// split lazily: a thread halves its remaining range only while another
+  /// thread is idle and nothing else waits for it, so the number of tasks
+  /// adapts to the load. Between these checks, `grain` indexes are processed
+  /// in a row, by default enough for 64 chunks per thread. The caller works
+  /// on the range too, and a thread of this pool keeps running other tasks
+  /// while it waits. The first exception stops the loop and is rethrown, a
+  /// piece discarded by `ShutdownMode::kCancelPending` throws a
+  /// `std::future_error` with `std::future_errc::broken_promise`.
+  template <typename Index, typename F>
+  void ParallelFor(Index begin, Index end, F&& fn, std::size_t grain = 0) {
+    // Const callables and functions are referred to as they are.
+    ForJob<Index, typename std::remove_reference<F>::type> job{begin, fn};
+    RunJob(job, Distance(begin, end), grain);
+  }
+  /// @brief Returns `reduce(identity, transform(i))` folded over every `i`
+  /// in [`begin`, `end`), computed in parallel like `ParallelFor`.
+  ///
+  /// `identity` must be the neutral element of `reduce`, which must be
+  /// associative and commutative, since partial results are combined in any
+  /// order.
+  template <typename Index, typename T, typename Transform, typename Reduce>
+  T ParallelReduce(Index begin, Index end, T identity, Transform&& transform,
+                   Reduce&& reduce, std::size_t grain = 0) {
+    ReduceJob<Index, T, typename std::remove_reference<Transform>::type,
+              typename std::remove_reference<Reduce>::type>
+        job{begin, identity, transform, reduce};
+    RunJob(job, Distance(begin, end), grain);
+    return std::move(job.result);
+  }
+  /// @brief Runs `fn(args...)` on the pool once `delay` has passed.
+  ///
+  /// All timers of a pool share one timing wheel and one timer thread, which
+  /// only hands due callables over to the pool, so pending timers occupy no
+  /// pool thread. The first timer starts the timer thread.
+  /// @return The handle of the timer.
+  template <typename Rep, typename Period, typename F, typename... Args>
+  Timer ScheduleAfter(const std::chrono::duration<Rep, Period>& delay, F&& fn,
+                      Args&&... args) {
+    return ScheduleTimer(
+        std::chrono::steady_clock::now() +
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                delay),
+        std::chrono::steady_clock::duration::zero(),
+        detail::Bind(std::forward<F>(fn), std::forward<Args>(args)...));
+  }
+  /// @brief Runs `fn(args...)` on the pool at `deadline`, like
+  /// `ScheduleAfter`.
+  template <typename Clock, typename Duration, typename F, typename... Args>
+  Timer ScheduleAt(const std::chrono::time_point<Clock, Duration>& deadline,
+                   F&& fn, Args&&... args) {
+    return ScheduleAfter(deadline - Clock::now(), std::forward<F>(fn),
+                         std::forward<Args>(args)...);
+  }
+  /// @brief Runs `fn(args...)` on the pool every `period`, starting one
+  /// `period` from now, like `ScheduleAfter`.
+  ///
+  /// Runs never overlap. The schedule does not drift, a run that starts
+  /// late is followed by the next one on time.
+  template <typename Rep, typename Period, typename F, typename... Args>
+  Timer ScheduleEvery(const std::chrono::duration<Rep, Period>& period,
+                      F&& fn, Args&&... args) {
+    auto interval =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+    return ScheduleTimer(
+        std::chrono::steady_clock::now() + interval, interval,
+        detail::Bind(std::forward<F>(fn), std::forward<Args>(args)...));
+  }
+  /// @brief Retrieves all results from the `ThreadPool` queue (non-blocking).
+  /// @return A vector containing all results from executed tasks.
+  std::vector<std::shared_ptr<void>> GrabAllResults() {
+    std::vector<std::shared_ptr<void>> results;
+    GrabAllResults(results);
+    return results;
+  }
+  /// @brief Appends all results to `results` (non-blocking).
+  ///
+  /// Every thread collects results in a buffer of its own. If `results` is
+  /// empty, the first non-empty buffer is swapped with it in O(1), the others
+  /// are moved over element by element, so reusing one vector per drain does
+  /// not allocate once the buffers have grown. Use the overload taking one
+  /// vector per buffer to drain in O(buffers). Threads only wait for the swap
+  /// of their buffer.
+  /// @return The number of results appended.
+  std::size_t GrabAllResults(std::vector<std::shared_ptr<void>>& results) {
+    std::lock_guard<std::mutex> grab_guard{grab_mtx_};
+    std::size_t before = results.size();
+    for (auto& worker : workers_) {
+      Grab(worker->results, results);
+    }
+    Grab(external_results_, results);
+    return results.size() - before;
+  }
+  /// @brief Drains the buffer of every thread into a slot of its own
+  /// (non-blocking).
+  ///
+  /// `shards` is resized to one slot per thread, up to `max_threads`, plus
+  /// one for the results of tasks run outside the pool. An empty slot is
+  /// swapped with its buffer in O(1), so a drain costs O(threads) however
+  /// many results there are, and both sides keep their capacity if `shards`
+  /// is cleared slot by slot and reused. Results are appended to a slot that
+  /// is not empty.
+  /// @return The number of results appended.
+  std::size_t GrabAllResults(
+      std::vector<std::vector<std::shared_ptr<void>>>& shards) {
+    std::lock_guard<std::mutex> grab_guard{grab_mtx_};
+    shards.resize(workers_.size() + 1);
+    std::size_t count = 0;
+    for (std::size_t i = 0; i <= workers_.size(); ++i) {
+      std::size_t before = shards[i].size();
+      Grab(i < workers_.size() ? workers_[i]->results : external_results_,
+           shards[i]);
+      count += shards[i].size() - before;
+    }
+    return count;
+  }
+  [[nodiscard]] std::uint32_t max_queue_size() const { return kMaxQueueSize; }
+  /// @brief Number of running threads, which varies if the pool is elastic.
+  [[nodiscard]] std::uint32_t num_threads() const {
+    return live_threads_.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] std::uint32_t max_threads() const { return kMaxThreads; }
+  /// @brief Index of the calling thread in this pool, below `max_threads`
+  /// and stable while the thread runs, so tasks can use per-thread slots of
+  /// shared data without locking. -1 if called from another thread.
+  [[nodiscard]] int CurrentWorkerIndex() const {
+    const Worker* self = CurrentWorker();
+    return self != nullptr && self->pool == this
+               ? static_cast<int>(self->index)
+               : -1;
+  }
+  [[nodiscard]] Scheduling scheduling() const { return kScheduling; }
+  [[nodiscard]] IdlePolicy idle_policy() const {
+    return IdleStrategy::Policy(kIdlePolicy);
+  }
+  [[nodiscard]] QueueBackend queue_backend() const {
+    return QueuePolicy::Backend(kQueueBackend);
+  }
+  /// @brief Counts threads not executing a task (O(1), never blocks).
+  size_t QueryIdleThreadsCount() const {
+    return idle_count_.value.load(std::memory_order_relaxed);
+  }
+  /// @brief Counts tasks in the shared queue and, approximately, in the local
+  /// deques of all threads.
+  size_t QueryWaitingQueueCount() const {
+    size_t count = 0;
+    for (const auto& worker : workers_) {
+      count += worker->deque.Size();
+    }
+    for (const auto& queue : waiting_queues_) {
+      count += queue->Size();
+    }
+    return count;
+  }
+  /// @brief Takes a snapshot of the statistics (O(threads), never blocks).
+  ///
+  /// Counters and histograms are only collected with the `CollectStats`
+  /// policy, which `ThreadPool` uses if `TINY_TP_STATS` is defined as 1
+  /// before including this header, and stay zero otherwise.
+  /// Each thread keeps its own, so collecting them involves no shared
+  /// writes.
+  PoolStats Stats() const {
+    PoolStats stats;
+    stats.uptime = std::chrono::steady_clock::now() - kCreated;
+    stats.threads = num_threads();
+    stats.idle_threads = QueryIdleThreadsCount();
+    stats.queued_tasks = QueryWaitingQueueCount();
+    stats.workers.resize(workers_.size());
+    if (!StatsPolicy::Collect()) {
+      return stats;
+    }
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < workers_.size(); ++i) {
+      const auto& counters = workers_[i]->counters;
+      auto& worker = stats.workers[i];
+      worker.tasks_executed = counters.tasks_executed.Load();
+      worker.steals = counters.steals.Load();
+      worker.parks = counters.parks.Load();
+      worker.unparks = counters.unparks.Load();
+      stats.total.tasks_executed += worker.tasks_executed;
+      stats.total.steals += worker.steals;
+      stats.total.parks += worker.parks;
+      stats.total.unparks += worker.unparks;
+      counters.wait_time.AddTo(stats.wait_time);
+      counters.run_time.AddTo(stats.run_time);
+    }
+    return stats;
+  }
+  /// @brief Writes what the threads did in the Chrome trace JSON format,
+  /// which `chrome://tracing` and Perfetto open (O(events), never blocks).
+  ///
+  /// Events are only recorded if `TINY_TP_TRACE` is defined as 1 before
+  /// including this header, and the trace lists the threads only otherwise.
+  /// Every thread keeps its latest `Options::trace_capacity` events: a slice
+  /// per task it ran, named after its `TraceLabel`, an async slice for the
+  /// time the task waited in the queue, and an instant event per steal.
+  /// Tasks run by threads outside the pool are not recorded.
+  void WriteTrace(std::ostream& out) const {
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    WriteTraceEvents(out, 1);
+    out << "]}";
+  }
+  size_t QueryResultsCount() {
+    std::size_t count = external_results_.Size();
+    for (auto& worker : workers_) {
+      count += worker->results.Size();
+    }
+    return count;
+  }
+
+ private:
+  friend class TaskGraph;
+  template <typename>
+  friend class BasicStrand;
+  friend class Executor;
+
+  /// @brief Type of the queued tasks, stamped with their enqueue time only
+  /// if statistics are collected.
+  using QueuedTask = typename std::conditional<StatsPolicy::Collect(),
+                                               detail::StampedTask,
+                                               detail::TaskFunction>::type;
+  /// @brief Type of the shared queues.
+  using Queue = typename QueuePolicy::template Queue<QueuedTask>;
+
+  /// @brief State of a `ParallelFor` or `ParallelReduce`, on the stack of
+  /// the caller.
+  struct RangeJob {
+    /// @brief Pieces of the range not finished yet.
+    std::atomic<std::size_t> pending{1};
+    std::size_t grain{1};
+    std::atomic<bool> failed{false};
+    /// @brief First exception, read once `pending` is zero.
+    std::exception_ptr error;
+  };
+  template <typename Index, typename F>
+  struct ForJob : RangeJob {
+    using State = bool;
+    ForJob(Index first, F& body) : begin{first}, fn(body) {}
+    State Start() { return true; }
+    void Process(State&, std::size_t first, std::size_t last) {
+      for (std::size_t i = first; i < last; ++i) {
+        fn(Advance(begin, i));
+      }
+    }
+    void Merge(State&) {}
+
+    Index begin;
+    F& fn;
+  };
+  template <typename Index, typename T, typename Transform, typename Reduce>
+  struct ReduceJob : RangeJob {
+    using State = T;
+    ReduceJob(Index first, const T& identity_value, Transform& transform_fn,
+              Reduce& reduce_fn)
+        : begin{first},
+          identity(identity_value),
+          result(identity_value),
+          transform(transform_fn),
+          reduce(reduce_fn) {}
+    /// @brief Every piece folds its chunks into a partial result of its own.
+    State Start() { return identity; }
+    void Process(State& partial, std::size_t first, std::size_t last) {
+      for (std::size_t i = first; i < last; ++i) {
+        partial = reduce(std::move(partial), transform(Advance(begin, i)));
+      }
+    }
+    void Merge(State& partial) {
+      std::lock_guard<std::mutex> guard{mtx};
+      result = reduce(std::move(result), std::move(partial));
+    }
+
+    Index begin;
+    const T identity;
+    T result;
+    Transform& transform;
+    Reduce& reduce;
+    std::mutex mtx;
+  };
+  /// @brief Task running a piece of a `RangeJob`. A piece discarded by
+  /// `ShutdownMode::kCancelPending` fails the job with a
+  /// `std::future_errc::broken_promise`, so that the caller does not wait
+  /// for it forever.
+  template <typename Job>
+  class RangeCall {
+   public:
+    RangeCall(BasicThreadPool* pool, Job* job, std::size_t first,
+              std::size_t last)
+        : pool_{pool}, job_{job}, first_{first}, last_{last} {}
+    RangeCall(RangeCall&& other) noexcept
+        : pool_{other.pool_},
+          job_{other.job_},
+          first_{other.first_},
+          last_{other.last_} {
+      other.job_ = nullptr;
+    }
+    RangeCall(const RangeCall&) = delete;
+    RangeCall& operator=(const RangeCall&) = delete;
+    ~RangeCall() {
+      if (job_ == nullptr) {
+        return;
+      }
+      if (!job_->failed.exchange(true, std::memory_order_relaxed)) {
+        job_->error = std::make_exception_ptr(
+            std::future_error{std::future_errc::broken_promise});
+      }
+      pool_->LeaveRange(*job_);
+    }
+    void operator()() {
+      Job* job = job_;
+      job_ = nullptr;
+      pool_->RunRange(*job, first_, last_);
+    }
+
+   private:
+    BasicThreadPool* pool_;
+    Job* job_;
+    std::size_t first_;
+    std::size_t last_;
+  };
+
+  template <typename Index>
+  static std::size_t Distance(Index begin, Index end) {
+    return end > begin ? static_cast<std::size_t>(end - begin) : 0;
+  }
+  template <typename Index>
+  static Index Advance(Index begin, std::size_t offset) {
+    return begin + static_cast<decltype(begin - begin)>(offset);
+  }
+  template <typename Job>
+  void RunJob(Job& job, std::size_t size, std::size_t grain) {
+    if (size == 0) {
+      return;
+    }
+    job.grain = grain != 0 ? grain
+                           : std::max<std::size_t>(
+                                 1, size / (std::size_t{kMaxThreads} * 64 + 1));
+    RunRange(job, 0, size);
+    Join(job.pending);
+    if (job.error != nullptr) {
+      std::rethrow_exception(job.error);
+    }
+  }
+  /// @brief Processes [`first`, `last`) of `job`, splitting off the upper
+  /// half whenever an idle thread could take it.
+  template <typename Job>
+  void RunRange(Job& job, std::size_t first, std::size_t last) {
+    try {
+      auto state = job.Start();
+      while (first < last && !job.failed.load(std::memory_order_relaxed)) {
+        if (last - first > job.grain && ShouldSplit()) {
+          std::size_t middle = first + (last - first) / 2;
+          job.pending.fetch_add(1, std::memory_order_relaxed);
+          QueuedTask piece{RangeCall<Job>{this, &job, middle, last}};
+          if (!EnqueueTask(std::move(piece), Priority::kNormal)) {
+            // Left untouched, it runs here instead.
+            piece();
+          }
+          last = middle;
+          continue;
+        }
+        std::size_t stop = std::min(first + job.grain, last);
+        job.Process(state, first, stop);
+        first = stop;
+      }
+      job.Merge(state);
+    } catch (...) {
+      if (!job.failed.exchange(true, std::memory_order_relaxed)) {
+        job.error = std::current_exception();
+      }
+    }
+    LeaveRange(job);
+  }
+  /// @brief Counts a piece of `job` as finished.
+  void LeaveRange(RangeJob& job) {
+    if (job.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      // The job lives on the stack of the caller, only the pool is touched.
+      if (join_event_.HasWaiters()) {
+        join_event_.NotifyAll();
+      }
+    }
+  }
+  /// @brief Whether a piece split off now would be picked up by an idle
+  /// thread rather than wait behind other tasks.
+  bool ShouldSplit() {
+    if (idle_count_.value.load(std::memory_order_relaxed) == 0) {
+      return false;
+    }
+    Worker* self = OwnWorker();
+    if (self != nullptr && kScheduling == Scheduling::kWorkStealing) {
+      return self->deque.Empty();
+    }
+    return ProducerQueue(self).Empty();
+  }
+  /// @brief Blocks until `pending` drops to zero. A thread of this pool runs
+  /// other tasks meanwhile.
+  void Join(const std::atomic<std::size_t>& pending) {
+    HelpUntil([&pending]() {
+      return pending.load(std::memory_order_seq_cst) == 0;
+    });
+  }
+  /// @brief Blocks until `done()` holds, which must be announced through
+  /// `join_event_`. A thread of this pool runs other tasks meanwhile.
+  template <typename Done>
+  void HelpUntil(const Done& done) {
+    Worker* self = OwnWorker();
+    while (!done()) {
+      QueuedTask task;
+      if (self != nullptr && Acquire(self, task)) {
+        RunAcquired(self, task);
+        continue;
+      }
+      auto key = join_event_.PrepareWait();
+      if (done()) {
+        join_event_.CancelWait();
+        break;
+      }
+      join_event_.Wait(key);
+    }
+  }
+  /// @brief Finishes `count` tasks on destruction, also if a task throws.
+  struct FinishGuard {
+    ~FinishGuard() { pool->Finish(count); }
+    BasicThreadPool* pool;
+    std::size_t count;
+  };
+  /// @brief Runs an admitted `task` on the calling thread.
+  void RunHere(QueuedTask& task) {
+    Worker* self = OwnWorker();
+    if (self != nullptr) {
+      Run(self, task);
+    } else {
+      ScratchArena& scratch = Scratch();
+      auto mark = scratch.GetMark();
+      task();
+      task.Reset();
+      scratch.Rewind(mark);
+    }
+  }
+
+#if TINY_TP_COROUTINES
+  /// @brief Resumes a coroutine suspended by `Schedule`, or frees its chain
+  /// if discarded without running, see `TaskPromiseBase::Abandon`.
+  class ResumeCall {
+   public:
+    ResumeCall(std::coroutine_handle<> coroutine,
+               detail::TaskPromiseBase* promise, std::coroutine_handle<> root)
+        : coroutine_{coroutine}, promise_{promise}, root_{root} {}
+    ResumeCall(ResumeCall&& other) noexcept
+        : coroutine_{other.coroutine_},
+          promise_{other.promise_},
+          root_{other.root_} {
+      other.Release();
+    }
+    ResumeCall(const ResumeCall&) = delete;
+    ResumeCall& operator=(const ResumeCall&) = delete;
+    ~ResumeCall() {
+      if (coroutine_) {
+        detail::TaskPromiseBase::Abandon(promise_, root_);
+      }
+    }
+    void operator()() {
+      auto coroutine = coroutine_;
+      Release();
+      coroutine.resume();
+    }
+    void Release() { coroutine_ = nullptr; }
+
+   private:
+    std::coroutine_handle<> coroutine_;
+    detail::TaskPromiseBase* promise_;
+    std::coroutine_handle<> root_;
+  };
+  template <typename T>
+  static detail::DetachedCoroutine Drive(BasicThreadPool* pool,
+                                         Priority priority, Task<T> task,
+                                         Promise<T> promise) {
+    co_await pool->Schedule(priority);
+    try {
+      if constexpr (std::is_void<T>::value) {
+        co_await task;
+        promise.SetValue();
+      } else {
+        promise.SetValue(co_await task);
+      }
+    } catch (...) {
+      promise.SetException(std::current_exception());
+    }
+  }
+#endif  // TINY_TP_COROUTINES
+
+  /// @brief Adapts an `ITask` to the queue, collecting its result.
+  class ITaskCall {
+   public:
+    ITaskCall(BasicThreadPool* pool, std::shared_ptr<ITask> task)
+        : pool_{pool}, task_{std::move(task)} {}
+    void operator()() { pool_->CollectResult(task_->Execute()); }
+    void Cancel() {}
+
+   private:
+    BasicThreadPool* pool_;
+    std::shared_ptr<ITask> task_;
+  };
+
+  /// @brief Wraps a task holding an admission credit, released when the
+  /// task is done or discarded.
+  template <typename F>
+  class CreditedCall {
+   public:
+    CreditedCall(F&& fn, AdmissionCredits* credits)
+        : fn_{std::move(fn)}, credits_{credits} {}
+    CreditedCall(CreditedCall&& other) noexcept
+        : fn_{std::move(other.fn_)}, credits_{other.credits_} {
+      other.credits_ = nullptr;
+    }
+    CreditedCall(const CreditedCall&) = delete;
+    CreditedCall& operator=(const CreditedCall&) = delete;
+    ~CreditedCall() {
+      if (credits_ != nullptr) {
+        credits_->Release();
+      }
+    }
+    void operator()() { fn_(); }
+
+   private:
+    F fn_;
+    AdmissionCredits* credits_;
+  };
+
+  /// @brief Wraps a task counted in a `TaskGroup` until it is done or
+  /// discarded.
+  template <typename F>
+  class GroupCall {
+   public:
+    GroupCall(F&& fn, TaskGroup* group) : fn_{std::move(fn)}, group_{group} {}
+    GroupCall(GroupCall&& other) noexcept
+        : fn_{std::move(other.fn_)}, group_{other.group_} {
+      other.group_ = nullptr;
+    }
+    GroupCall(const GroupCall&) = delete;
+    GroupCall& operator=(const GroupCall&) = delete;
+    ~GroupCall() {
+      if (group_ != nullptr) {
+        group_->Done();
+      }
+    }
+    void operator()() {
+      try {
+        fn_();
+      } catch (...) {
+        group_->Fail(std::current_exception());
+      }
+    }
+
+   private:
+    F fn_;
+    TaskGroup* group_;
+  };
+
+  /// @brief Results of the tasks run by one thread, or by threads outside
+  /// the pool.
+  struct ResultShard {
+    std::size_t Size() {
+      std::lock_guard<std::mutex> guard{mtx};
+      return results.size();
+    }
+
+    std::mutex mtx;
+    std::vector<std::shared_ptr<void>> results;
+    /// @brief Swapped with `results` by `Grab`, so that both keep their
+    /// capacity. Guarded by `grab_mtx_`.
+    std::vector<std::shared_ptr<void>> spare;
+  };
+
+  /// @brief Wraps a task that is discarded when dequeued if `token` was
+  /// cancelled or has expired by then.
+  template <typename F>
+  class CancellableCall {
+   public:
+    CancellableCall(F&& fn, const CancellationToken& token)
+        : fn_{std::move(fn)}, token_{token} {}
+    void operator()() {
+      if (token_.IsCancelled()) {
+        fn_.Cancel();
+      } else {
+        fn_();
+      }
+    }
+
+   private:
+    F fn_;
+    CancellationToken token_;
+  };
+
+  enum class WorkerState : std::uint8_t { kIdle, kBusy };
+
+  /// @brief Per-thread state of the `ThreadPool`.
+  struct Worker {
+    Worker(BasicThreadPool* owner, std::uint32_t i)
+        : pool{owner}, index{i}, rng_state{0x9E3779B97F4A7C15ull * (i + 1)} {}
+    /// @brief Returns the next pseudo-random number (xorshift64).
+    std::uint64_t NextRandom() {
+      rng_state ^= rng_state << 13;
+      rng_state ^= rng_state >> 7;
+      rng_state ^= rng_state << 17;
+      return rng_state;
+    }
+
+    BasicThreadPool* const pool;
+    const std::uint32_t index;
+    /// @brief Local deque, only used in `Scheduling::kWorkStealing` mode.
+    detail::WorkStealingDeque<QueuedTask> deque;
+    std::uint64_t rng_state;
+    /// @brief Written only by the owner thread, read by anyone.
+    detail::CacheLinePadded<std::atomic<WorkerState>> state{
+        {}, {WorkerState::kIdle}, {}};
+    /// @brief Whether a thread runs for this worker, guarded by `scale_mtx_`.
+    bool alive{false};
+    /// @brief Whether the last thread of this worker has returned from its
+    /// stop hook, so another one may start, guarded by `scale_mtx_`.
+    bool exited{true};
+    /// @brief NUMA node of the worker, 0 unless `Placement::kNumaNodes`.
+    std::uint32_t node{0};
+    /// @brief CPUs the thread is pinned to, any if empty.
+    std::vector<unsigned> cpus;
+    /// @brief Tasks taken from a shared queue at once, run from `batch_next`
+    /// on. This and the following are only touched by the owner thread.
+    std::vector<QueuedTask> batch;
+    std::size_t batch_next{0};
+    /// @brief Results of the batch, published together at its end.
+    std::vector<std::shared_ptr<void>> held_results;
+    /// @brief Published results of the tasks run by this thread.
+    ResultShard results;
+    /// @brief Tasks of the batch that ran, accounted for at its end.
+    std::size_t held{0};
+    /// @brief `Scratch` of the thread, set when it starts.
+    ScratchArena* scratch{nullptr};
+    /// @brief Statistics of the thread, empty unless they are collected.
+    typename std::conditional<StatsPolicy::Collect(), detail::WorkerCounters,
+                              detail::NoWorkerCounters>::type counters;
+#if TINY_TP_TRACE
+    detail::TraceRing trace;
+#endif
+  };
+
+  /// @brief Assigns workers to nodes and CPUs and creates the shared queues.
+  void Place(const Options& options) {
+    std::vector<std::vector<unsigned>> nodes;
+    if (options.placement == Placement::kNumaNodes) {
+      nodes = detail::NumaNodes();
+    } else {
+      nodes.emplace_back();
+    }
+    std::vector<unsigned> cpus;
+    if (options.placement == Placement::kCpuList) {
+      cpus = options.cpus;
+    } else if (options.placement == Placement::kPhysicalCores) {
+      cpus = detail::PhysicalCores();
+    }
+    node_workers_.resize(nodes.size());
+    for (auto& worker : workers_) {
+      if (nodes.size() > 1) {
+        worker->node = worker->index % nodes.size();
+        worker->cpus = nodes[worker->node];
+      } else if (!cpus.empty()) {
+        worker->cpus.assign(1, cpus[worker->index % cpus.size()]);
+      }
+      node_workers_[worker->node].push_back(worker.get());
+    }
+    for (std::uint32_t node = 0; node < nodes.size(); ++node) {
+      waiting_queues_.emplace_back(
+          QueuePolicy::template Make<QueuedTask>(options.queue_backend,
+                                                 options.max_queue_size,
+                                                 options.priority_aging));
+      for (unsigned cpu : nodes[node]) {
+        if (cpu >= cpu_nodes_.size()) {
+          cpu_nodes_.resize(cpu + 1, 0);
+        }
+        cpu_nodes_[cpu] = node;
+      }
+    }
+  }
+  /// @brief The shared queue tasks enqueued by the calling thread go to: the
+  /// queue of its node, known from `worker` or from the CPU it runs on.
+  Queue& ProducerQueue(Worker* worker) {
+    if (waiting_queues_.size() == 1) {
+      return *waiting_queues_[0];
+    }
+    if (worker == nullptr) {
+      worker = OwnWorker();
+    }
+    if (worker != nullptr) {
+      return *waiting_queues_[worker->node];
+    }
+    int cpu = detail::CurrentCpu();
+    return *waiting_queues_[cpu >= 0 && static_cast<std::size_t>(cpu) <
+                                            cpu_nodes_.size()
+                                ? cpu_nodes_[cpu]
+                                : 0];
+  }
+  static Options MakeOptions(std::uint32_t num_threads,
+                             std::uint32_t max_queue_size) {
+    Options options;
+    options.num_threads = num_threads;
+    options.max_queue_size = max_queue_size;
+    return options;
+  }
+  /// @brief The worker running on the calling thread, if any.
+  static Worker*& CurrentWorker() {
+    static thread_local Worker* worker = nullptr;
+    return worker;
+  }
+  /// @brief The calling thread's worker if it belongs to this pool,
+  /// `nullptr` otherwise.
+  Worker* OwnWorker() const {
+    Worker* worker = CurrentWorker();
+    return (worker != nullptr && worker->pool == this) ? worker : nullptr;
+  }
+  /// @brief The calling thread's worker if a task of `priority` goes to its
+  /// local deque, `nullptr` otherwise.
+  Worker* LocalWorker(Priority priority) const {
+    return (kScheduling == Scheduling::kWorkStealing &&
+            priority == Priority::kNormal)
+               ? OwnWorker()
+               : nullptr;
+  }
+
+  /// @brief Accounts for `count` tasks about to be enqueued.
+  /// @return False if the pool no longer accepts tasks from this thread.
+  bool Admit(std::size_t count) {
+    // Counted before checking `stopping_`, so `WaitIdle` in `Shutdown`
+    // either sees these tasks or they are rejected here.
+    unfinished_.value.fetch_add(count, std::memory_order_seq_cst);
+    if (quit_.load(std::memory_order_seq_cst) ||
+        (stopping_.load(std::memory_order_seq_cst) && OwnWorker() == nullptr)) {
+      Finish(count);
+      return false;
+    }
+    return true;
+  }
+  /// @brief Accounts for `count` enqueued tasks that finished or were
+  /// rejected.
+  void Finish(std::size_t count) {
+    if (count != 0 && unfinished_.value.fetch_sub(
+                          count, std::memory_order_seq_cst) == count) {
+      done_event_.NotifyAll();
+    }
+  }
+
+  /// @brief Enqueues `task`, built outside the pool, like `EnqueueTask`.
+  /// `task` is left untouched if rejected.
+  bool Enqueue(detail::TaskFunction&& task, Priority priority,
+               bool may_run_here = true) {
+    return Enqueue(std::move(task), priority, may_run_here,
+                   std::is_same<QueuedTask, detail::TaskFunction>{});
+  }
+  bool Enqueue(detail::TaskFunction&& task, Priority priority,
+               bool may_run_here, std::true_type) {
+    return EnqueueTask(std::move(task), priority, may_run_here);
+  }
+  bool Enqueue(detail::TaskFunction&& task, Priority priority,
+               bool may_run_here, std::false_type) {
+    QueuedTask queued{std::move(task)};
+    if (EnqueueTask(std::move(queued), priority, may_run_here)) {
+      return true;
+    }
+    task = std::move(queued);
+    return false;
+  }
+  /// @brief Enqueues `task`, falling back from a full local deque to the
+  /// shared queue. If the queue is full, `task` is run on the calling thread
+  /// instead with `OverflowPolicy::kCallerRuns` unless `may_run_here` is
+  /// false. `task` is left untouched if rejected.
+  bool EnqueueTask(QueuedTask&& task, Priority priority,
+                   bool may_run_here = true) {
+    if (!Admit(1)) {
+      CountRejected(1);
+      return false;
+    }
+    StampEnqueue(task);
+    Worker* worker = LocalWorker(priority);
+    if (worker != nullptr && worker->deque.Size() < kMaxQueueSize) {
+      worker->deque.Push(new QueuedTask{std::move(task)});
+    } else if (!ProducerQueue(worker).Push(std::move(task), priority)) {
+      if (may_run_here && kOverflowPolicy == OverflowPolicy::kCallerRuns) {
+        FinishGuard finish_guard{this, 1};
+        RunHere(task);
+        return true;
+      }
+      Finish(1);
+      CountRejected(1);
+      return false;
+    }
+    idle_event_.NotifyOne();
+    MaybeGrow();
+    return true;
+  }
+  /// @brief Enqueues `task`, waiting until `deadline` for space in the
+  /// shared queue while it is full. `task` is left untouched if rejected.
+  bool EnqueueUntil(QueuedTask&& task, Priority priority,
+                    const std::chrono::steady_clock::time_point& deadline) {
+    while (!EnqueueTask(std::move(task), priority, false)) {
+      if (stopping_.load(std::memory_order_seq_cst)) {
+        return false;
+      }
+      auto key = space_event_.PrepareWait();
+      if (ProducerQueue(nullptr).Size() < kMaxQueueSize ||
+          stopping_.load(std::memory_order_seq_cst)) {
+        space_event_.CancelWait();
+        continue;
+      }
+      if (deadline == std::chrono::steady_clock::time_point::max()) {
+        space_event_.Wait(key);
+      } else if (!space_event_.WaitUntil(key, deadline)) {
+        return EnqueueTask(std::move(task), priority, false);
+      }
+    }
+    return true;
+  }
+  bool DropUntil(std::shared_ptr<ITask> task, AdmissionCredits& credits,
+                 Priority priority,
+                 const std::chrono::steady_clock::time_point& deadline) {
+    if (!credits.AcquireUntil(deadline)) {
+      return false;
+    }
+    // Releases the credit again if rejected.
+    return EnqueueUntil(
+        QueuedTask{CreditedCall<ITaskCall>{
+            ITaskCall{this, std::move(task)}, &credits}},
+        priority, deadline);
+  }
+  Timer ScheduleTimer(std::chrono::steady_clock::time_point when,
+                      std::chrono::steady_clock::duration period,
+                      detail::TaskFunction&& fn) {
+    std::lock_guard<std::mutex> timers_guard{timers_mtx_};
+    if (stopping_.load(std::memory_order_seq_cst)) {
+      return Timer{};
+    }
+    if (timers_ == nullptr) {
+      timers_.reset(new detail::TimerWheel{kTimerTick});
+    }
+    return Timer{timers_.get(), timers_->Schedule(when, period, std::move(fn),
+                                                  &DispatchTimer, this)};
+  }
+  static bool DispatchTimer(void* pool, detail::TaskFunction&& task) {
+    // Never runs a task on the timer thread.
+    return static_cast<BasicThreadPool*>(pool)->Enqueue(
+        std::move(task), Priority::kNormal, false);
+  }
+  /// @brief Enqueues the tasks of `batch` in order until the queue is full,
+  /// then runs the rest on the calling thread with
+  /// `OverflowPolicy::kCallerRuns`.
+  /// @return The number of tasks enqueued or run.
+  std::size_t EnqueueBatch(std::vector<QueuedTask>& batch,
+                           Priority priority) {
+    if (!Admit(batch.size())) {
+      CountRejected(batch.size());
+      return 0;
+    }
+    if (StatsPolicy::Collect()) {
+      auto now = std::chrono::steady_clock::now();
+      for (auto& task : batch) {
+        detail::StampEnqueued(task, now);
+      }
+    }
+#if TINY_TP_TRACE
+    auto traced = detail::ReadTsc();
+    for (auto& task : batch) {
+      task.traced = traced;
+      task.label = TraceLabel::Current();
+    }
+#endif
+    std::size_t accepted = 0;
+    Worker* worker = LocalWorker(priority);
+    if (worker != nullptr) {
+      std::size_t size = worker->deque.Size();
+      accepted = size < kMaxQueueSize
+                     ? std::min<std::size_t>(batch.size(), kMaxQueueSize - size)
+                     : 0;
+      for (std::size_t i = 0; i < accepted; ++i) {
+        worker->deque.Push(new QueuedTask{std::move(batch[i])});
+      }
+    }
+    if (accepted < batch.size()) {
+      accepted += ProducerQueue(worker).PushBatch(batch, priority, accepted);
+    }
+    if (accepted < batch.size() &&
+        kOverflowPolicy == OverflowPolicy::kCallerRuns) {
+      idle_event_.Notify(accepted);
+      MaybeGrow();
+      FinishGuard finish_guard{this, batch.size() - accepted};
+      for (std::size_t i = accepted; i < batch.size(); ++i) {
+        RunHere(batch[i]);
+      }
+      return batch.size();
+    }
+    Finish(batch.size() - accepted);
+    CountRejected(batch.size() - accepted);
+    idle_event_.Notify(accepted);
+    MaybeGrow();
+    return accepted;
+  }
+  /// @brief Starts a thread if the pool is elastic, all threads are busy and
+  /// enough tasks wait.
+  void MaybeGrow() {
+    if (kMaxThreads == kNumThreads || !ShouldGrow()) {
+      return;
+    }
+    std::lock_guard<std::mutex> scale_guard{scale_mtx_};
+    GrowLocked();
+  }
+  /// @brief Starts a thread in a free slot if needed, must hold `scale_mtx_`.
+  /// Slots whose retired thread still runs its stop hook are skipped, that
+  /// thread calls this again once it has exited.
+  void GrowLocked() {
+    if (!ShouldGrow() || quit_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    for (auto& worker : workers_) {
+      if (worker->exited) {
+        StartLocked(worker.get());
+        return;
+      }
+    }
+  }
+  bool ShouldGrow() {
+    // Pairs with the fence in `Retire`, a task is either seen by a retiring
+    // thread or the retirement is seen here.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto live = live_threads_.load(std::memory_order_relaxed);
+    if (live >= kMaxThreads ||
+        idle_count_.value.load(std::memory_order_relaxed) != 0) {
+      return false;
+    }
+    auto unfinished = unfinished_.value.load(std::memory_order_relaxed);
+    if (live == 0) {
+      // Nothing would ever run the task otherwise.
+      return unfinished != 0;
+    }
+    // All running threads are busy, the others are waiting.
+    return unfinished >= std::size_t{live} + kGrowQueueDepth;
+  }
+  /// @brief Starts the thread of `worker`, must hold `scale_mtx_`.
+  void StartLocked(Worker* worker) {
+    auto self = std::this_thread::get_id();
+    for (auto& thread : exited_threads_) {
+      if (thread.get_id() != self) {
+        thread.join();
+      }
+    }
+    exited_threads_.erase(
+        std::remove_if(exited_threads_.begin(), exited_threads_.end(),
+                       [](const std::thread& thread) {
+                         return !thread.joinable();
+                       }),
+        exited_threads_.end());
+    auto& thread = threads_[worker->index];
+    if (thread.get_id() == self) {
+      // A retired thread restarting its own slot, it is joined later.
+      exited_threads_.push_back(std::move(thread));
+    } else if (thread.joinable()) {
+      // The retired thread has set `exited` and released `scale_mtx_`, it
+      // only has to return from `Cycle`.
+      thread.join();
+    }
+    worker->alive = true;
+    worker->exited = false;
+    live_threads_.fetch_add(1, std::memory_order_relaxed);
+    idle_count_.value.fetch_add(1, std::memory_order_seq_cst);
+    thread = std::thread{&BasicThreadPool::Cycle, this, worker};
+  }
+  /// @brief Lets an idle `self` exit if the pool has more threads than
+  /// its minimum and no task is waiting.
+  /// @return True if the thread must leave `Cycle`.
+  bool Retire(Worker* self) {
+    std::lock_guard<std::mutex> scale_guard{scale_mtx_};
+    if (quit_.load(std::memory_order_relaxed) ||
+        live_threads_.load(std::memory_order_relaxed) <= kNumThreads) {
+      return false;
+    }
+    idle_count_.value.fetch_sub(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (HasWaitingTasks()) {
+      idle_count_.value.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    self->alive = false;
+    live_threads_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  /// @brief Stores the result of an `ITask`.
+  void CollectResult(std::shared_ptr<void> result) {
+    if (!TaskPolicy::Keep() || result == nullptr) {
+      return;
+    }
+    Worker* self = OwnWorker();
+    if (self != nullptr && self->batch_next < self->batch.size()) {
+      self->held_results.push_back(std::move(result));
+      return;
+    }
+    ResultShard& shard = self != nullptr ? self->results : external_results_;
+    std::lock_guard<std::mutex> results_guard{shard.mtx};
+    shard.results.push_back(std::move(result));
+  }
+  /// @brief Publishes the results held back by `self` at once.
+  void FlushResults(Worker* self) {
+    if (self->held_results.empty()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> results_guard{self->results.mtx};
+      for (auto& result : self->held_results) {
+        self->results.results.push_back(std::move(result));
+      }
+    }
+    self->held_results.clear();
+  }
+  /// @brief Moves the results of `shard` to `results`, see `GrabAllResults`.
+  static void Grab(ResultShard& shard,
+                   std::vector<std::shared_ptr<void>>& results) {
+    {
+      std::lock_guard<std::mutex> results_guard{shard.mtx};
+      if (shard.results.empty()) {
+        return;
+      }
+      if (results.empty()) {
+        results.swap(shard.results);
+        return;
+      }
+      shard.spare.swap(shard.results);
+    }
+    std::move(shard.spare.begin(), shard.spare.end(),
+              std::back_inserter(results));
+    shard.spare.clear();
+  }
+
+  /// @brief Takes the next task for `self`: urgent tasks of the shared queue
+  /// first, then its local deque, then the shared queue, then the local deques
+  /// of random victims.
+  ///
+  /// With several NUMA nodes, the tasks of the own node come first and other
+  /// nodes are only tried as a last resort.
+  bool Acquire(Worker* self, QueuedTask& task) {
+    const bool stealing = kScheduling == Scheduling::kWorkStealing;
+    auto& home = *waiting_queues_[self->node];
+    if (self->batch_next < self->batch.size()) {
+      if (!home.HasUrgent() || !TakeShared(self, home, task)) {
+        task = std::move(self->batch[self->batch_next++]);
+      }
+      if (self->batch_next == self->batch.size()) {
+        self->batch.clear();
+        self->batch_next = 0;
+      }
+      return true;
+    }
+    if (stealing && home.HasUrgent() && TakeShared(self, home, task)) {
+      return true;
+    }
+    if (stealing && TakeOwned(self->deque.Pop(), task)) {
+      return true;
+    }
+    if (TakeShared(self, home, task)) {
+      return true;
+    }
+    if (stealing && Steal(self, node_workers_[self->node], task)) {
+      return true;
+    }
+    for (std::size_t i = 1; i < waiting_queues_.size(); ++i) {
+      auto node = (self->node + i) % waiting_queues_.size();
+      if (TakeShared(self, *waiting_queues_[node], task) ||
+          (stealing && Steal(self, node_workers_[node], task))) {
+        return true;
+      }
+    }
+    return false;
+  }
+  /// @brief Steals from `victims`, starting at a random one.
+  static bool Steal(Worker* self, const std::vector<Worker*>& victims,
+                    QueuedTask& task) {
+    if (victims.empty()) {
+      return false;
+    }
+    auto start = static_cast<std::size_t>(self->NextRandom() % victims.size());
+    for (std::size_t i = 0; i < victims.size(); ++i) {
+      Worker* victim = victims[(start + i) % victims.size()];
+      if (victim != self && TakeOwned(victim->deque.Steal(), task)) {
+        if (StatsPolicy::Collect()) {
+          self->counters.steals.Add();
+        }
+#if TINY_TP_TRACE
+        self->trace.Record(detail::TraceEvent{detail::TraceEvent::Kind::kSteal,
+                                              nullptr, victim->index, 0,
+                                              detail::ReadTsc(), 0});
+#endif
+        return true;
+      }
+    }
+    return false;
+  }
+  /// @brief Takes a task from `queue`, and with `Options::dequeue_batch`
+  /// more of them into the empty batch of `self`. The batch leaves as many
+  /// tasks in the queue for each idle thread as it takes.
+  bool TakeShared(Worker* self, Queue& queue, QueuedTask& task) {
+    std::size_t count = 1;
+    if (kDequeueBatch > 1 && self->batch.empty()) {
+      std::size_t idle = idle_count_.value.load(std::memory_order_relaxed);
+      count = std::min<std::size_t>(kDequeueBatch, queue.Size() / (idle + 1));
+    }
+    if (count <= 1) {
+      if (!queue.TryPop(task)) {
+        return false;
+      }
+      count = 1;
+    } else {
+      count = queue.TryPopBatch(self->batch, count);
+      if (count == 0) {
+        return false;
+      }
+      task = std::move(self->batch[0]);
+      self->batch_next = 1;
+      if (count == 1) {
+        self->batch.clear();
+        self->batch_next = 0;
+      }
+    }
+    // Let producers blocked on the full queue in.
+    if (space_event_.HasWaiters()) {
+      space_event_.Notify(count);
+    }
+    return true;
+  }
+  static bool TakeOwned(QueuedTask* item, QueuedTask& task) {
+    if (item == nullptr) {
+      return false;
+    }
+    task = std::move(*item);
+    delete item;
+    return true;
+  }
+  bool HasWaitingTasks() {
+    if (kScheduling == Scheduling::kWorkStealing) {
+      for (const auto& worker : workers_) {
+        if (!worker->deque.Empty()) {
+          return true;
+        }
+      }
+    }
+    for (const auto& queue : waiting_queues_) {
+      if (!queue->Empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+  /// @brief Busy-waits according to the idle policy until a task shows up.
+  /// @return True if a task was acquired, false if the thread should block.
+  bool SpinAcquire(Worker* self, QueuedTask& task) {
+    if (idle_policy() == IdlePolicy::kBlock) {
+      return false;
+    }
+    std::uint32_t spins = kSpinCount;
+    std::uint32_t yields =
+        idle_policy() == IdlePolicy::kSpinYieldPark ? kYieldCount : 0;
+    while ((spins > 0 || yields > 0) && !quit_.load(std::memory_order_relaxed)) {
+      // Every enqueue bumps the epoch, so only re-scan when it has changed.
+      auto key = idle_event_.Epoch();
+      if (Acquire(self, task)) {
+        return true;
+      }
+      while (idle_event_.Epoch() == key && (spins > 0 || yields > 0)) {
+        if (spins > 0) {
+          --spins;
+          detail::CpuRelax();
+        } else {
+          --yields;
+          std::this_thread::yield();
+        }
+      }
+    }
+    return Acquire(self, task);
+  }
+  /// @brief Blocks the calling thread until a task may be available.
+  /// @return False if `deadline` passed first.
+  bool Park(Worker* self,
+            const std::chrono::steady_clock::time_point& deadline) {
+    auto key = idle_event_.PrepareWait();
+    if (quit_.load(std::memory_order_seq_cst) || HasWaitingTasks()) {
+      idle_event_.CancelWait();
+      return true;
+    }
+    bool notified = true;
+    if (deadline == std::chrono::steady_clock::time_point::max()) {
+      idle_event_.Wait(key);
+    } else {
+      notified = idle_event_.WaitUntil(key, deadline);
+    }
+    if (StatsPolicy::Collect()) {
+      self->counters.parks.Add();
+      self->counters.unparks.Add(notified ? 1 : 0);
+    }
+    return notified;
+  }
+
+  /// @brief Main function for thread pool execution cycle.
+  void Cycle(Worker* self) {
+    CurrentWorker() = self;
+    self->scratch = &Scratch();
+    if (!self->cpus.empty()) {
+      detail::PinThisThread(self->cpus);
+    }
+    if (!kThreadName.empty()) {
+      detail::NameThisThread(kThreadName + "-" + std::to_string(self->index));
+    }
+    if (kOnThreadStart) {
+      kOnThreadStart(self->index);
+    }
+    const bool elastic = kMaxThreads > kNumThreads;
+    bool retired = false;
+    auto idle_deadline =
+        elastic ? std::chrono::steady_clock::now() + kKeepAlive
+                : std::chrono::steady_clock::time_point::max();
+    // Main loop for each thread, until `Shutdown` tells it to quit.
+    while (!quit_.load(std::memory_order_acquire)) {
+      // Try to take a task, keep waiting until there is one.
+      QueuedTask task;
+      if (!Acquire(self, task)) {
+        if (elastic &&
+            self->state.value.load(std::memory_order_relaxed) ==
+                WorkerState::kBusy) {
+          idle_deadline = std::chrono::steady_clock::now() + kKeepAlive;
+        }
+        // Update thread to idle state, only once per run of tasks.
+        SetState(self, WorkerState::kIdle);
+        if (!SpinAcquire(self, task)) {
+          if (!Park(self, idle_deadline)) {
+            if (Retire(self)) {
+              retired = true;
+              break;
+            }
+            idle_deadline = std::chrono::steady_clock::now() + kKeepAlive;
+          }
+          continue;
+        }
+      }
+      // Update thread to non-idle state.
+      SetState(self, WorkerState::kBusy);
+      // Tasks that queued up while this thread was waking up may need help.
+      MaybeGrow();
+
+      RunAcquired(self, task);
+    }
+    // Only left early by `ShutdownMode::kCancelPending`.
+    FlushResults(self);
+    Finish(self->held);
+    self->held = 0;
+    if (kOnThreadStop) {
+      kOnThreadStop(self->index);
+    }
+    CurrentWorker() = nullptr;
+    if (retired) {
+      std::lock_guard<std::mutex> scale_guard{scale_mtx_};
+      self->exited = true;
+      // Tasks queued while the stop hook ran may have found no free slot.
+      GrowLocked();
+    }
+  }
+  /// @brief Runs a task of `Acquire`. While the batch has more tasks, the
+  /// results and the accounting of this one are held back, and both are
+  /// published at the end of the batch, results first so that `WaitIdle`
+  /// never returns before they can be grabbed.
+  void RunAcquired(Worker* self, QueuedTask& task) {
+    Run(self, task);
+    if (self->batch_next < self->batch.size()) {
+      ++self->held;
+      return;
+    }
+    FlushResults(self);
+    Finish(self->held + 1);
+    self->held = 0;
+  }
+  /// @brief Runs `task` on the thread of `self`. Its scratch memory is
+  /// released afterwards, but not what an outer task running it allocated.
+  void Run(Worker* self, QueuedTask& task) {
+    auto mark = self->scratch->GetMark();
+#if TINY_TP_TRACE
+    // Tasks submitted by this one inherit its label.
+    const char* outer_label = TraceLabel::Current();
+    detail::TraceEvent event{detail::TraceEvent::Kind::kRun, task.label, 0,
+                             task.traced, detail::ReadTsc(), 0};
+    TraceLabel::Current() = task.label;
+#endif
+    if (StatsPolicy::Collect()) {
+      auto start = std::chrono::steady_clock::now();
+      self->counters.wait_time.Record(start - detail::EnqueuedAt(task));
+      task();
+      task.Reset();
+      self->counters.run_time.Record(std::chrono::steady_clock::now() - start);
+      self->counters.tasks_executed.Add();
+    } else {
+      task();
+      task.Reset();
+    }
+#if TINY_TP_TRACE
+    event.end = detail::ReadTsc();
+    self->trace.Record(event);
+    TraceLabel::Current() = outer_label;
+#endif
+    self->scratch->Rewind(mark);
+  }
+  /// @brief Writes the events of `WriteTrace`, as process `pid`.
+  void WriteTraceEvents(std::ostream& out, int pid) const {
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+        << ",\"args\":{\"name\":";
+    detail::WriteJsonString(
+        out, kThreadName.empty() ? "tiny_tp" : kThreadName.c_str());
+    out << "}}";
+#if TINY_TP_TRACE
+    // Calibrates the counter against the steady clock since construction.
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - kCreated)
+                       .count();
+    auto ticks = detail::ReadTsc() - kCreatedTsc;
+    double ns_per_tick = elapsed > 0 && ticks > 0
+                             ? static_cast<double>(elapsed) /
+                                   static_cast<double>(ticks)
+                             : 1.0;
+    auto nanoseconds = [&](std::uint64_t tsc) -> std::uint64_t {
+      return tsc <= kCreatedTsc ? 0
+                                : static_cast<std::uint64_t>(
+                                      static_cast<double>(tsc - kCreatedTsc) *
+                                      ns_per_tick);
+    };
+    std::vector<detail::TraceEvent> events;
+    // Async slices of different processes must not share ids.
+    auto id = static_cast<std::uint64_t>(pid) << 32;
+    for (const auto& worker : workers_) {
+      const auto tid = worker->index;
+      out << ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+          << ",\"tid\":" << tid << ",\"args\":{\"name\":";
+      detail::WriteJsonString(
+          out, ((kThreadName.empty() ? std::string{"thread"} : kThreadName) +
+                "-" + std::to_string(tid))
+                   .c_str());
+      out << "}}";
+      events.clear();
+      worker->trace.Snapshot(events);
+      for (const auto& event : events) {
+        auto start = nanoseconds(event.start);
+        if (event.kind == detail::TraceEvent::Kind::kSteal) {
+          out << ",{\"name\":\"steal\",\"cat\":\"steal\",\"ph\":\"i\","
+              << "\"s\":\"t\",\"pid\":" << pid << ",\"tid\":" << tid
+              << ",\"ts\":";
+          detail::WriteMicros(out, start);
+          out << ",\"args\":{\"victim\":" << event.victim << "}}";
+          continue;
+        }
+        const char* label = event.label != nullptr ? event.label : "task";
+        out << ",{\"name\":";
+        detail::WriteJsonString(out, label);
+        out << ",\"cat\":\"task\",\"ph\":\"X\",\"pid\":" << pid
+            << ",\"tid\":" << tid << ",\"ts\":";
+        detail::WriteMicros(out, start);
+        out << ",\"dur\":";
+        detail::WriteMicros(out,
+                            std::max(nanoseconds(event.end), start) - start);
+        out << "}";
+        if (event.enqueued == 0) {
+          continue;
+        }
+        ++id;
+        for (int phase = 0; phase < 2; ++phase) {
+          out << ",{\"name\":";
+          detail::WriteJsonString(out, label);
+          out << ",\"cat\":\"queue\",\"ph\":\"" << (phase == 0 ? 'b' : 'e')
+              << "\",\"id\":" << id << ",\"pid\":" << pid
+              << ",\"tid\":" << tid << ",\"ts\":";
+          detail::WriteMicros(
+              out, phase == 0 ? std::min(nanoseconds(event.enqueued), start)
+                              : start);
+          out << "}";
+        }
+      }
+    }
+#endif
+  }
+  /// @brief Stamps `task` with its enqueue time for the statistics and
+  /// traces.
+  static void StampEnqueue(QueuedTask& task) {
+    if (StatsPolicy::Collect()) {
+      detail::StampEnqueued(task, std::chrono::steady_clock::now());
+    }
+#if TINY_TP_TRACE
+    task.traced = detail::ReadTsc();
+    task.label = TraceLabel::Current();
+#endif
+    (void)task;
+  }
+  void CountRejected(std::size_t count) {
+    if (StatsPolicy::Collect() && count != 0) {
+      rejected_.fetch_add(count, std::memory_order_relaxed);
+    }
+  }
+  void SetState(Worker* self, WorkerState state) {
+    auto& slot = self->state.value;
+    if (slot.load(std::memory_order_relaxed) == state) {
+      return;
+    }
+    slot.store(state, std::memory_order_relaxed);
+    if (state == WorkerState::kIdle) {
+      idle_count_.value.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      idle_count_.value.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  /// @brief Shared queues, one per NUMA node in `Placement::kNumaNodes` mode;
+  /// the injection queues in work-stealing mode.
+  std::vector<std::unique_ptr<Queue>> waiting_queues_;
+  /// @brief Workers of each node, in the order victims are tried.
+  std::vector<std::vector<Worker*>> node_workers_;
+  /// @brief Node of each CPU, for producers outside the pool.
+  std::vector<std::uint32_t> cpu_nodes_;
+  /// @brief Parks idle threads until tasks arrive.
+  detail::EventCount idle_event_;
+  /// @brief Parks producers until the shared queue has space.
+  detail::EventCount space_event_;
+  /// @brief Results of tasks run outside the pool, e.g. by
+  /// `OverflowPolicy::kCallerRuns`.
+  ResultShard external_results_;
+  /// @brief Serializes `GrabAllResults`.
+  std::mutex grab_mtx_;
+  /// @brief Number of threads in `WorkerState::kIdle`.
+  detail::CacheLinePadded<std::atomic<std::uint32_t>> idle_count_{{}, {0}, {}};
   const uint32_t kMaxQueueSize;
   const uint32_t kNumThreads;
-  /// @brief Shared pointer for marking thread exit.
-  std::shared_ptr<std::uint32_t> exit_mark_;
+  const std::uint32_t kMaxThreads;
+  const std::uint32_t kGrowQueueDepth;
+  const std::chrono::steady_clock::duration kKeepAlive;
+  const Scheduling kScheduling;
+  const QueueBackend kQueueBackend;
+  const IdlePolicy kIdlePolicy;
+  const std::uint32_t kSpinCount;
+  const std::uint32_t kYieldCount;
+  const std::chrono::steady_clock::duration kTimerTick;
+  const OverflowPolicy kOverflowPolicy;
+  const std::uint32_t kDequeueBatch;
+  const std::string kThreadName;
+  const std::function<void(std::uint32_t)> kOnThreadStart;
+  const std::function<void(std::uint32_t)> kOnThreadStop;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  /// @brief One slot per worker, empty while the worker never had a thread.
+  std::vector<std::thread> threads_;
+  /// @brief Retired threads that restarted their own slot on exit.
+  std::vector<std::thread> exited_threads_;
+  std::atomic<std::uint32_t> live_threads_{0};
+  /// @brief Guards starting and retiring threads.
+  std::mutex scale_mtx_;
+  const std::chrono::steady_clock::time_point kCreated{
+      std::chrono::steady_clock::now()};
+#if TINY_TP_TRACE
+  const std::uint64_t kCreatedTsc{detail::ReadTsc()};
+#endif
+  /// @brief Only counted if statistics are collected.
+  std::atomic<std::uint64_t> rejected_{0};
+  /// @brief Number of tasks enqueued but not finished yet.
+  detail::CacheLinePadded<std::atomic<std::size_t>> unfinished_{{}, {0}, {}};
+  /// @brief Wakes up threads blocked in `WaitIdle`.
+  detail::EventCount done_event_;
+  /// @brief Wakes up threads joining a `ParallelFor` or `ParallelReduce`.
+  detail::EventCount join_event_;
+  /// @brief Set once `Shutdown` starts, external tasks are rejected.
+  std::atomic<bool> stopping_{false};
+  /// @brief Set once threads must exit, all tasks are rejected.
+  std::atomic<bool> quit_{false};
+  std::mutex shutdown_mtx_;
+  /// @brief Created by the first timer.
+  std::unique_ptr<detail::TimerWheel> timers_;
+  std::mutex timers_mtx_;
+};
+
+template <typename QueuePolicy, typename TaskPolicy, typename IdleStrategy,
+          typename StatsPolicy>
+constexpr std::uint32_t BasicThreadPool<QueuePolicy, TaskPolicy, IdleStrategy,
+                                        StatsPolicy>::kDefaultMaxQueueSize;
+
+/// @brief A directed acyclic graph of tasks, run on a `ThreadPool`.
+///
+/// A node becomes ready once all of its predecessors have finished. The
+/// thread finishing a node runs one ready successor right away and enqueues
+/// the others, so no thread ever blocks waiting for a dependency. Nodes are
+/// allocated once, a graph can be run again as soon as its previous run is
+/// done.
+class TaskGraph {
+ public:
+  /// @brief A task of the graph, owned by its `TaskGraph`.
+  class Node {
+   public:
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
+
+    /// @brief Makes this node run before `other`.
+    Node& Precede(Node& other) {
+      successors_.push_back(&other);
+      ++other.num_predecessors_;
+      graph_->checked_ = false;
+      return *this;
+    }
+    /// @brief Makes this node run after `other`.
+    Node& Succeed(Node& other) {
+      other.Precede(*this);
+      return *this;
+    }
+    std::size_t num_predecessors() const { return num_predecessors_; }
+    std::size_t num_successors() const { return successors_.size(); }
+
+   private:
+    friend class TaskGraph;
+
+    Node(TaskGraph* graph, detail::TaskFunction&& fn)
+        : graph_{graph}, fn_{std::move(fn)} {}
+
+    TaskGraph* const graph_;
+    detail::TaskFunction fn_;
+    std::vector<Node*> successors_;
+    std::uint32_t num_predecessors_{0};
+    /// @brief Predecessors left in the current run.
+    std::atomic<std::uint32_t> pending_{0};
+  };
+
+  TaskGraph() = default;
+  TaskGraph(const TaskGraph&) = delete;
+  TaskGraph& operator=(const TaskGraph&) = delete;
+
+  /// @brief Adds a node running `fn(args...)` on every run of the graph.
+  template <typename F, typename... Args>
+  Node& Emplace(F&& fn, Args&&... args) {
+    nodes_.emplace_back(new Node{
+        this, detail::Bind(std::forward<F>(fn), std::forward<Args>(args)...)});
+    checked_ = false;
+    return *nodes_.back();
+  }
+  std::size_t size() const { return nodes_.size(); }
+  bool empty() const { return nodes_.empty(); }
+
+  /// @brief Runs every node once on `pool`, respecting the dependencies.
+  ///
+  /// The graph must not be modified or run again until the returned `Future`
+  /// is ready. If a node throws, the nodes not started yet are skipped and
+  /// the `Future` holds the first exception. Nodes the pool rejects run on
+  /// the thread that made them ready. If `ShutdownMode::kCancelPending`
+  /// discards a node, the nodes after it are skipped and the `Future` holds
+  /// a `std::future_error` with `std::future_errc::broken_promise`.
+  /// @throw std::invalid_argument if the graph has a cycle.
+  template <typename Q, typename T, typename I, typename S>
+  Future<void> Run(BasicThreadPool<Q, T, I, S>& pool) {
+    return Start(&pool, &EnqueueOn<BasicThreadPool<Q, T, I, S>>);
+  }
+
+ private:
+  /// @brief Task running a node and the chain of successors it readies, or
+  /// skipping them if it is discarded without running.
+  class NodeCall {
+   public:
+    NodeCall(TaskGraph* graph, Node* node) : graph_{graph}, node_{node} {}
+    NodeCall(NodeCall&& other) noexcept
+        : graph_{other.graph_}, node_{other.node_} {
+      other.node_ = nullptr;
+    }
+    NodeCall(const NodeCall&) = delete;
+    NodeCall& operator=(const NodeCall&) = delete;
+    ~NodeCall() {
+      if (node_ != nullptr) {
+        graph_->Fail(std::make_exception_ptr(
+            std::future_error{std::future_errc::broken_promise}));
+        graph_->Skip(node_);
+      }
+    }
+    void operator()() {
+      Node* node = node_;
+      node_ = nullptr;
+      graph_->Execute(node);
+    }
+
+   private:
+    TaskGraph* graph_;
+    Node* node_;
+  };
+
+  template <typename Pool>
+  static bool EnqueueOn(void* pool, detail::TaskFunction&& task) {
+    return static_cast<Pool*>(pool)->Enqueue(std::move(task),
+                                             Priority::kNormal);
+  }
+  Future<void> Start(void* pool,
+                     bool (*enqueue)(void*, detail::TaskFunction&&)) {
+    if (!checked_) {
+      CheckAcyclic();
+    }
+    promise_ = Promise<void>{};
+    auto future = promise_.GetFuture();
+    if (nodes_.empty()) {
+      promise_.SetValue();
+      return future;
+    }
+    pool_ = pool;
+    enqueue_ = enqueue;
+    failed_.store(false, std::memory_order_relaxed);
+    error_ = nullptr;
+    std::vector<Node*> roots;
+    for (auto& node : nodes_) {
+      node->pending_.store(node->num_predecessors_, std::memory_order_relaxed);
+      if (node->num_predecessors_ == 0) {
+        roots.push_back(node.get());
+      }
+    }
+    remaining_.store(nodes_.size(), std::memory_order_release);
+    for (Node* root : roots) {
+      Schedule(root);
+    }
+    return future;
+  }
+  void Schedule(Node* node) {
+    detail::TaskFunction call{NodeCall{this, node}};
+    if (!enqueue_(pool_, std::move(call))) {
+      // Left untouched, it runs here instead.
+      call();
+    }
+  }
+  void Fail(std::exception_ptr error) {
+    if (!failed_.exchange(true, std::memory_order_relaxed)) {
+      error_ = std::move(error);
+    }
+  }
+  void Execute(Node* node) {
+    while (node != nullptr) {
+      if (!failed_.load(std::memory_order_relaxed)) {
+        try {
+          node->fn_();
+        } catch (...) {
+          Fail(std::current_exception());
+        }
+      }
+      // Keep one ready successor on this thread, hand the others out.
+      Node* next = nullptr;
+      for (Node* successor : node->successors_) {
+        if (successor->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          if (next == nullptr) {
+            next = successor;
+          } else {
+            Schedule(successor);
+          }
+        }
+      }
+      if (Leave()) {
+        return;
+      }
+      node = next;
+    }
+  }
+  /// @brief Counts down `node` and the successors only it would have
+  /// readied without running them, nor handing them to the pool.
+  void Skip(Node* node) {
+    for (Node* successor : node->successors_) {
+      if (successor->pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        Skip(successor);
+      }
+    }
+    Leave();
+  }
+  /// @brief Counts a node as done, completing the run after the last one.
+  /// @return True if the run is complete.
+  bool Leave() {
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return false;
+    }
+    // The last node, the graph may be reused once the promise is set.
+    Promise<void> promise{std::move(promise_)};
+    if (error_ != nullptr) {
+      promise.SetException(std::move(error_));
+    } else {
+      promise.SetValue();
+    }
+    return true;
+  }
+  /// @brief Checks by topological sorting (Kahn) that the graph can finish.
+  void CheckAcyclic() {
+    std::vector<Node*> ready;
+    for (auto& node : nodes_) {
+      node->pending_.store(node->num_predecessors_, std::memory_order_relaxed);
+      if (node->num_predecessors_ == 0) {
+        ready.push_back(node.get());
+      }
+    }
+    std::size_t visited = 0;
+    while (!ready.empty()) {
+      Node* node = ready.back();
+      ready.pop_back();
+      ++visited;
+      for (Node* successor : node->successors_) {
+        auto left = successor->pending_.load(std::memory_order_relaxed) - 1;
+        successor->pending_.store(left, std::memory_order_relaxed);
+        if (left == 0) {
+          ready.push_back(successor);
+        }
+      }
+    }
+    if (visited != nodes_.size()) {
+      throw std::invalid_argument{"tiny_tp::TaskGraph has a cycle"};
+    }
+    checked_ = true;
+  }
+
+  std::vector<std::unique_ptr<Node>> nodes_;
+  bool checked_{true};
+  /// @brief The pool of the current run and how to enqueue into it.
+  void* pool_{nullptr};
+  bool (*enqueue_)(void*, detail::TaskFunction&&){nullptr};
+  Promise<void> promise_;
+  std::atomic<std::size_t> remaining_{0};
+  std::atomic<bool> failed_{false};
+  /// @brief First exception of the run, read once `remaining_` is zero.
+  std::exception_ptr error_;
+};
+
+/// @brief Runs its tasks one at a time in FIFO order on a `ThreadPool`.
+///
+/// A strand has no thread of its own: while it has tasks, one task of the
+/// pool runs up to `batch_size` of them in a row and then enqueues itself
+/// again, so ordering per key costs no idle threads and the hand-off is paid
+/// once per batch. Successive tasks may run on different threads, each one
+/// seeing the effects of the previous ones. The queue of a strand is
+/// unbounded. If the pool rejects the strand, the tasks run on the calling
+/// thread. The destructor waits until every task has run.
+template <typename Pool>
+class BasicStrand {
+ public:
+  static constexpr std::size_t kDefaultBatchSize{64};
+
+  /// @param pool The `ThreadPool` running the tasks, it must outlive this.
+  /// @param batch_size The number of tasks run per hand-off.
+  /// @param priority The priority of the strand in the pool.
+  explicit BasicStrand(Pool& pool,
+                       std::size_t batch_size = kDefaultBatchSize,
+                       Priority priority = Priority::kNormal)
+      : pool_{pool}, kBatchSize{std::max<std::size_t>(batch_size, 1)},
+        kPriority{priority} {}
+  BasicStrand(const BasicStrand&) = delete;
+  BasicStrand& operator=(const BasicStrand&) = delete;
+  ~BasicStrand() { WaitIdle(); }
+
+  /// @brief Adds a task, its result goes to `ThreadPool::GrabAllResults`.
+  void Drop(std::shared_ptr<ITask> task) {
+    Push(detail::TaskFunction{
+        typename Pool::ITaskCall{&pool_, std::move(task)}});
+  }
+  /// @brief Adds a callable, like `ThreadPool::Submit`.
+  /// @return A `Future` for the result of the callable.
+  template <typename F, typename... Args>
+  Future<detail::ResultOf<F, Args...>> Submit(F&& fn, Args&&... args) {
+    using R = detail::ResultOf<F, Args...>;
+    using Call = decltype(
+        detail::Bind(std::forward<F>(fn), std::forward<Args>(args)...));
+    Promise<R> promise;
+    auto future = promise.GetFuture();
+    Push(detail::TaskFunction{detail::PromiseCall<R, Call>{
+        detail::Bind(std::forward<F>(fn), std::forward<Args>(args)...),
+        std::move(promise)}});
+    return future;
+  }
+  /// @brief Blocks until every task added so far has run. Must not be called
+  /// from a task of this strand.
+  void WaitIdle() {
+    std::unique_lock<std::mutex> unique_lock{mtx_};
+    idle_cond_.wait(unique_lock, [this]() { return !scheduled_; });
+  }
+
+ private:
+  /// @brief Task of the pool draining the strand. If the pool discards it,
+  /// the tasks of the strand are discarded too.
+  class DrainCall {
+   public:
+    explicit DrainCall(BasicStrand* strand) : strand_{strand} {}
+    DrainCall(DrainCall&& other) noexcept : strand_{other.strand_} {
+      other.strand_ = nullptr;
+    }
+    DrainCall(const DrainCall&) = delete;
+    DrainCall& operator=(const DrainCall&) = delete;
+    ~DrainCall() {
+      if (strand_ != nullptr) {
+        strand_->Discard();
+      }
+    }
+    void operator()() {
+      BasicStrand* strand = strand_;
+      strand_ = nullptr;
+      if (strand->disarm_) {
+        strand->disarm_ = false;
+        return;
+      }
+      strand->Drain();
+    }
+
+   private:
+    BasicStrand* strand_;
+  };
+
+  /// @brief Hands the strand over to the pool.
+  /// @return False if the pool rejected it, the caller then keeps draining.
+  bool Schedule() {
+    detail::TaskFunction drain{DrainCall{this}};
+    if (pool_.Enqueue(std::move(drain), kPriority, false)) {
+      return true;
+    }
+    // Neither discard the tasks nor drain with the rejected call.
+    disarm_ = true;
+    drain();
+    return false;
+  }
+
+  void Push(detail::TaskFunction&& task) {
+    {
+      std::lock_guard<std::mutex> guard{mtx_};
+      queue_.push_back(std::move(task));
+      if (scheduled_) {
+        return;
+      }
+      scheduled_ = true;
+    }
+    if (!Schedule()) {
+      Drain();
+    }
+  }
+  /// @brief Runs batches of tasks until the queue is empty or the strand is
+  /// handed back to the pool. Only one thread drains at a time.
+  void Drain() {
+    while (true) {
+      {
+        std::lock_guard<std::mutex> guard{mtx_};
+        std::size_t count = std::min(queue_.size(), kBatchSize);
+        for (std::size_t i = 0; i < count; ++i) {
+          batch_.push_back(std::move(queue_.front()));
+          queue_.pop_front();
+        }
+      }
+      for (auto& task : batch_) {
+        task();
+      }
+      batch_.clear();
+      {
+        std::lock_guard<std::mutex> guard{mtx_};
+        if (queue_.empty()) {
+          scheduled_ = false;
+          idle_cond_.notify_all();
+          return;
+        }
+      }
+      // Let other tasks of the pool run between two batches.
+      if (Schedule()) {
+        return;
+      }
+    }
+  }
+  /// @brief Drops the queued tasks once the pool discarded the strand.
+  void Discard() {
+    std::deque<detail::TaskFunction, PoolAllocator<detail::TaskFunction>>
+        discarded;
+    std::lock_guard<std::mutex> guard{mtx_};
+    discarded.swap(queue_);
+    scheduled_ = false;
+    idle_cond_.notify_all();
+  }
+
+  Pool& pool_;
+  const std::size_t kBatchSize;
+  const Priority kPriority;
+  std::mutex mtx_;
+  std::condition_variable idle_cond_;
+  std::deque<detail::TaskFunction, PoolAllocator<detail::TaskFunction>> queue_;
+  /// @brief Whether a thread drains the strand or a `DrainCall` is queued.
+  bool scheduled_{false};
+  /// @brief The batch being run, only touched by the draining thread.
+  std::vector<detail::TaskFunction> batch_;
+  /// @brief Set by the draining thread to disarm a rejected `DrainCall`.
+  bool disarm_{false};
+};
+
+/// @brief A strand on a `ThreadPool`.
+using Strand = BasicStrand<ThreadPool>;
+
+/// @brief Statistics of both pools of an `Executor`.
+struct ExecutorStats {
+  PoolStats cpu;
+  PoolStats blocking;
+};
+
+/// @brief Runs CPU-bound and blocking work on two pools of its own.
+///
+/// The CPU pool has one thread per core and never grows, the blocking pool
+/// is elastic, so a burst of blocking calls makes the blocking pool grow
+/// instead of starving computations. Tasks move between them with
+/// `SubmitBlocking` and `Submit`, or with `Schedule` and `ScheduleBlocking`
+/// in coroutines. Timers all run on the timer thread of the CPU pool, and
+/// `Shutdown` stops both pools. While it drains, tasks the blocking pool
+/// hands back to the stopped CPU pool run on the blocking pool.
+class Executor {
+ public:
+  struct Options {
+    Options() : cpu{}, blocking{} {
+      cpu.thread_name = "cpu";
+      blocking.num_threads = 1;
+      blocking.max_threads = 256;
+      blocking.keep_alive = std::chrono::seconds{10};
+      blocking.thread_name = "blocking";
+    }
+    /// @brief Options of the CPU pool, by default one thread per core.
+    ThreadPool::Options cpu;
+    /// @brief Options of the blocking pool, by default one thread that grows
+    /// to 256 while all are busy.
+    ThreadPool::Options blocking;
+  };
+
+  explicit Executor(const Options& options)
+      : cpu_{options.cpu}, blocking_{options.blocking} {}
+  Executor() : Executor{Options{}} {}
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+  ~Executor() { Shutdown(ShutdownMode::kDrain); }
+
+  /// @brief Stops both pools and joins their threads (blocking), the CPU
+  /// pool first so that its draining tasks can still block. Must not be
+  /// called from a thread of either pool.
+  void Shutdown(ShutdownMode mode) {
+    cpu_.Shutdown(mode);
+    blocking_.Shutdown(mode);
+  }
+  /// @brief Blocks until neither pool has queued or running tasks, also
+  /// counting the tasks they hand each other meanwhile.
+  void WaitIdle() {
+    for (;;) {
+      auto handoffs = handoffs_.load(std::memory_order_seq_cst);
+      cpu_.WaitIdle();
+      blocking_.WaitIdle();
+      // The two pools are read one after the other. Work the blocking pool
+      // handed to the CPU pool in between is seen as a new hand-off, since
+      // it is counted before the handing task finishes.
+      if (cpu_.unfinished_.value.load(std::memory_order_seq_cst) == 0 &&
+          blocking_.unfinished_.value.load(std::memory_order_seq_cst) == 0 &&
+          handoffs_.load(std::memory_order_seq_cst) == handoffs) {
+        return;
+      }
+    }
+  }
+
+  /// @brief Adds a CPU-bound callable, like `ThreadPool::Submit`.
+  template <typename F, typename... Args>
+  Future<detail::ResultOf<F, Args...>> Submit(F&& fn, Args&&... args) {
+    return Submit(Priority::kNormal, std::forward<F>(fn),
+                  std::forward<Args>(args)...);
+  }
+  /// @brief Adds a CPU-bound callable with the given priority level.
+  template <typename F, typename... Args>
+  Future<detail::ResultOf<F, Args...>> Submit(Priority priority, F&& fn,
+                                              Args&&... args) {
+    using R = detail::ResultOf<F, Args...>;
+    using Call = decltype(
+        detail::Bind(std::forward<F>(fn), std::forward<Args>(args)...));
+    Promise<R> promise;
+    auto future = promise.GetFuture();
+    if (!EnqueueCpu(detail::TaskFunction{detail::PromiseCall<R, Call>{
+                        detail::Bind(std::forward<F>(fn),
+                                     std::forward<Args>(args)...),
+                        std::move(promise)}},
+                    priority)) {
+      return Future<R>{};
+    }
+    return future;
+  }
+  /// @brief Adds a CPU-bound callable, like `ThreadPool::Post`.
+  template <typename F, typename... Args>
+  bool Post(F&& fn, Args&&... args) {
+    return EnqueueCpu(detail::TaskFunction{detail::Bind(
+                          std::forward<F>(fn), std::forward<Args>(args)...)},
+                      Priority::kNormal);
+  }
+  /// @brief Adds a callable that blocks, e.g. on I/O, like
+  /// `ThreadPool::Submit`.
+  template <typename F, typename... Args>
+  Future<detail::ResultOf<F, Args...>> SubmitBlocking(F&& fn,
+                                                      Args&&... args) {
+    const bool handoff = cpu_.CurrentWorkerIndex() >= 0;
+    auto future =
+        blocking_.Submit(std::forward<F>(fn), std::forward<Args>(args)...);
+    CountHandOff(handoff);
+    return future;
+  }
+  /// @brief Adds a callable that blocks, like `ThreadPool::Post`.
+  template <typename F, typename... Args>
+  bool PostBlocking(F&& fn, Args&&... args) {
+    const bool handoff = cpu_.CurrentWorkerIndex() >= 0;
+    bool posted =
+        blocking_.Post(std::forward<F>(fn), std::forward<Args>(args)...);
+    CountHandOff(handoff);
+    return posted;
+  }
+  /// @brief Blocks until `future` is ready. A thread of the CPU pool runs
+  /// other CPU tasks meanwhile, others just block.
+  template <typename R>
+  void WaitFor(const Future<R>& future) {
+    cpu_.WaitFor(future);
+  }
+
+#if TINY_TP_COROUTINES
+  /// @brief Awaitable of `Schedule` and `ScheduleBlocking`.
+  class ScheduleAwaiter {
+   public:
+    ScheduleAwaiter(ThreadPool::ScheduleAwaiter awaiter, Executor* handoff)
+        : awaiter_{awaiter}, handoff_{handoff} {}
+    bool await_ready() const noexcept { return false; }
+    template <typename P>
+    bool await_suspend(std::coroutine_handle<P> coroutine) {
+      // Once enqueued, the coroutine may resume and free this awaiter.
+      Executor* handoff = handoff_;
+      if (!awaiter_.await_suspend(coroutine)) {
+        return false;
+      }
+      if (handoff != nullptr) {
+        handoff->CountHandOff(true);
+      }
+      return true;
+    }
+    bool await_resume() const noexcept { return awaiter_.await_resume(); }
+
+   private:
+    ThreadPool::ScheduleAwaiter awaiter_;
+    /// @brief Set if the coroutine moves from the other pool.
+    Executor* handoff_;
+  };
+
+  /// @brief Resumes the coroutine on the CPU pool, see
+  /// `ThreadPool::Schedule`.
+  ScheduleAwaiter Schedule(Priority priority = Priority::kNormal) {
+    return ScheduleAwaiter{
+        cpu_.Schedule(priority),
+        blocking_.CurrentWorkerIndex() >= 0 ? this : nullptr};
+  }
+  /// @brief Resumes the coroutine on the blocking pool, where it may block
+  /// until it moves back with `Schedule`.
+  ScheduleAwaiter ScheduleBlocking(Priority priority = Priority::kNormal) {
+    return ScheduleAwaiter{blocking_.Schedule(priority),
+                           cpu_.CurrentWorkerIndex() >= 0 ? this : nullptr};
+  }
+#endif
+
+  /// @brief Runs `fn(args...)` on the CPU pool after `delay`, see
+  /// `ThreadPool::ScheduleAfter`. Blocking work is started from there with
+  /// `PostBlocking`.
+  template <typename Rep, typename Period, typename F, typename... Args>
+  Timer ScheduleAfter(const std::chrono::duration<Rep, Period>& delay, F&& fn,
+                      Args&&... args) {
+    return cpu_.ScheduleAfter(delay, std::forward<F>(fn),
+                              std::forward<Args>(args)...);
+  }
+  /// @brief Runs `fn(args...)` on the CPU pool at `deadline`.
+  template <typename Clock, typename Duration, typename F, typename... Args>
+  Timer ScheduleAt(const std::chrono::time_point<Clock, Duration>& deadline,
+                   F&& fn, Args&&... args) {
+    return cpu_.ScheduleAt(deadline, std::forward<F>(fn),
+                           std::forward<Args>(args)...);
+  }
+  /// @brief Runs `fn(args...)` on the CPU pool every `period`.
+  template <typename Rep, typename Period, typename F, typename... Args>
+  Timer ScheduleEvery(const std::chrono::duration<Rep, Period>& period,
+                      F&& fn, Args&&... args) {
+    return cpu_.ScheduleEvery(period, std::forward<F>(fn),
+                              std::forward<Args>(args)...);
+  }
+
+  /// @brief Takes a snapshot of the statistics of both pools.
+  ExecutorStats Stats() const {
+    ExecutorStats stats;
+    stats.cpu = cpu_.Stats();
+    stats.blocking = blocking_.Stats();
+    return stats;
+  }
+  /// @brief Writes the traces of both pools as one, the CPU pool as
+  /// process 1 and the blocking pool as process 2, see
+  /// `ThreadPool::WriteTrace`.
+  void WriteTrace(std::ostream& out) const {
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    cpu_.WriteTraceEvents(out, 1);
+    out << ",";
+    blocking_.WriteTraceEvents(out, 2);
+    out << "]}";
+  }
+
+  ThreadPool& cpu() { return cpu_; }
+  ThreadPool& blocking() { return blocking_; }
+
+ private:
+  /// @brief Enqueues on the CPU pool, or on the blocking pool for tasks it
+  /// hands back once the CPU pool is stopping.
+  bool EnqueueCpu(detail::TaskFunction&& task, Priority priority) {
+    const bool handoff = blocking_.CurrentWorkerIndex() >= 0;
+    if (cpu_.Enqueue(std::move(task), priority)) {
+      CountHandOff(handoff);
+      return true;
+    }
+    return handoff && cpu_.stopping_.load(std::memory_order_seq_cst) &&
+           blocking_.Enqueue(std::move(task), priority);
+  }
+  /// @brief Records work a task of one pool gave to the other one, once it
+  /// is enqueued and before the giving task finishes, for `WaitIdle`.
+  void CountHandOff(bool handoff) {
+    if (handoff) {
+      handoffs_.fetch_add(1, std::memory_order_seq_cst);
+    }
+  }
+
+  ThreadPool cpu_;
+  ThreadPool blocking_;
+  /// @brief Number of hand-offs between the pools so far.
+  std::atomic<std::uint64_t> handoffs_{0};
 };
 
-constexpr std::uint32_t ThreadPool::kDefaultMaxQueueSize;
+template <typename Pool>
+constexpr std::size_t BasicStrand<Pool>::kDefaultBatchSize;
 
+}  // namespace TINY_TP_ABI
 }  // namespace tiny_tp
 
-#endif  // TINY_TP_HPP_
\ No newline at end of file
+#endif  // TINY_TP_HPP_